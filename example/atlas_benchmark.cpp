@@ -0,0 +1,36 @@
+#include <Mathyw/window.hpp>
+#include <Mathyw/texture_atlas.hpp>
+#include <Mathyw/clock.hpp>
+#include <cstdio>
+#include <random>
+
+// Pack a fixed-seed set of rectangles and print the density and the time per insertion
+// @param min_size, max_size: range of the width and height of the rectangles (in pixels)
+static void benchmark(char const* name, Mathyw::Ivec2 page_size, int channels, int count, int min_size, int max_size)
+{
+	std::mt19937 random(42);
+	std::uniform_int_distribution<int> size(min_size, max_size);
+	std::vector<std::uint8_t> pixels(std::size_t(max_size) * max_size * channels, 0x80);
+
+	Mathyw::TextureAtlas atlas(page_size, channels);
+	Mathyw::Clock clock;
+	for (int i = 0; i < count; i++)
+		atlas.Insert(pixels.data(), Mathyw::Ivec2(size(random), size(random)));
+	double seconds = clock.Elapsed();
+
+	auto stats = atlas.Stats();
+	std::printf("%-8s %5d rects %3d-%3d px: %2d pages of %dx%d, density %5.1f%%, %6.2f us per insert (%5.2f us placing)\n",
+		name, count, min_size, max_size, stats.pages, page_size[0], page_size[1], stats.Density() * 100.0f,
+		seconds / count * 1e6, stats.pack_seconds / count * 1e6);
+}
+
+int main(int argc, char** argv)
+{
+	// the pages are textures, a hidden window provides the context
+	Mathyw::Window window(64, 64, "Atlas benchmark", Mathyw::WindowHeadless);
+
+	benchmark("glyphs", Mathyw::Ivec2(1024, 1024), 1, 4000, 6, 48);
+	benchmark("sprites", Mathyw::Ivec2(2048, 2048), 4, 1000, 16, 160);
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+#include <Mathyw/image_writer.hpp>
+#include <Mathyw/clock.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <thread>
+
+// A synthetic 4K frame: smooth gradients with noise, compressible like a rendered frame but not trivially
+static Mathyw::Image synthetic_frame(int channels)
+{
+	Mathyw::Image image{ Mathyw::Ivec2(3840, 2160), channels, {} };
+	image.pixels.resize(std::size_t(image.size[0]) * image.size[1] * channels);
+	std::mt19937 random(42);
+	std::size_t i = 0;
+	for (int y = 0; y < image.size[1]; y++)
+		for (int x = 0; x < image.size[0]; x++)
+		{
+			int noise = random() % 4;
+			image.pixels[i++] = std::uint8_t(x / 15 + noise);
+			image.pixels[i++] = std::uint8_t(y / 9 + noise);
+			image.pixels[i++] = std::uint8_t((x + y) / 24);
+			if (channels == 4) image.pixels[i++] = 255;
+		}
+	return image;
+}
+
+// Run the encoder a few times and print the best throughput (in MB/s of raw pixels)
+static void benchmark(char const* name, Mathyw::Image const& image, std::function<std::size_t()> const& encode)
+{
+	constexpr int runs = 3;
+	double best = 1e9;
+	std::size_t encoded = 0;
+	for (int i = 0; i < runs; i++)
+	{
+		Mathyw::Clock clock;
+		encoded = encode();
+		best = std::min(best, clock.Elapsed());
+	}
+	double megabytes = image.pixels.size() / 1e6;
+	std::printf("%-20s %s: %8.1f ms %8.1f MB/s  ratio %5.1f%%\n", name, image.channels == 4 ? "RGBA" : "RGB ",
+		best * 1e3, megabytes / best, 100.0 * encoded / image.pixels.size());
+}
+
+int main(int argc, char** argv)
+{
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	std::printf("3840x2160 frames, best of 3 runs, %u hardware threads\n", threads);
+	std::vector<unsigned> counts = { 1 };
+	if (threads > 1) counts.push_back(threads);
+
+	for (int channels : { 3, 4 })
+	{
+		auto image = synthetic_frame(channels);
+		benchmark("QOI", image, [&] { return Mathyw::EncodeQOI(image).size(); });
+		for (int level : { 0, 1 })
+			for (unsigned count : counts)
+			{
+				char name[32];
+				std::snprintf(name, sizeof(name), "PNG level %d, %u th", level, count);
+				benchmark(name, image, [&] { return Mathyw::EncodePNG(image, level, count).size(); });
+			}
+	}
+
+	return 0;
+}
@@ -3,16 +3,31 @@
 // Core headers
 #include "./clock.hpp"
 #include "./core.hpp"
+#include "./draw_batch.hpp"
 #include "./event.hpp"
+#include "./event_queue.hpp"
 #include "./font.hpp"
+#include "./frame_capture.hpp"
+#include "./framebuffer.hpp"
+#include "./image_writer.hpp"
+#include "./input_state.hpp"
 #include "./inputcode.hpp"
 #include "./matrix.hpp"
+#include "./mesh_pool.hpp"
 #include "./monitor.hpp"
 #include "./numeric.hpp"
 #include "./opengl.hpp"
+#include "./profiler.hpp"
+#include "./render_thread.hpp"
+#include "./run_loop.hpp"
 #include "./shader.hpp"
+#include "./shader_variants.hpp"
+#include "./state_cache.hpp"
 #include "./texture.hpp"
+#include "./texture_atlas.hpp"
+#include "./texture_loader.hpp"
 #include "./transformation.hpp"
+#include "./uniform_buffer.hpp"
 #include "./value_tracker.hpp"
 #include "./vector.hpp"
 #include "./vertex_array.hpp"
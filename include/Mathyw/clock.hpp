@@ -4,21 +4,91 @@
 
 namespace Mathyw {
 
-// Measure a time duration of specific code (in seconds)
+// Measure a time duration of specific code with the steady clock.
+// Keeps nanoseconds as integers, so the precision does not degrade with uptime.
+// Independent of GLFW, usable before a window exists and on any thread.
 class Clock final
 {
 public:
 	// Construct and restart the time point
 	Clock();
 
-	// returns the time passed since the last restart
-	float Elapsed() const;
+	// Returns the nanoseconds of the steady clock since an unspecified epoch
+	static std::int64_t Now();
 
-	// restart the timer and returns the time elapsed
-	float Restart();
+	// Returns the time passed since the last restart (in seconds)
+	double Elapsed() const;
+
+	// Returns the time passed since the last restart (in nanoseconds)
+	std::int64_t ElapsedNanoseconds() const;
+
+	// Restart the timer and returns the time elapsed (in seconds)
+	double Restart();
+
+	// Restart the timer and returns the time elapsed (in nanoseconds)
+	std::int64_t RestartNanoseconds();
+
+private:
+	std::int64_t timepoint;
+};
+
+// Accumulates durations such as frame times in constant memory, for processes running for days.
+// Percentiles come from a log-linear histogram with a relative error below 1/32.
+class FrameStats final
+{
+public:
+	// A range of durations and how many samples fell into it (in seconds)
+	struct Bucket final
+	{
+		double lower, upper;
+		std::uint64_t count;
+	};
+
+	// Initialize an empty accumulator
+	FrameStats();
+
+	// Add a duration (in nanoseconds), negative durations count as zero
+	void Add(std::int64_t nanoseconds);
+
+	// Remove every sample
+	void Reset();
+
+	// Returns the number of samples
+	inline std::uint64_t Count() const { return count; }
+
+	// Returns the shortest duration (in seconds), zero without samples
+	double Min() const;
+
+	// Returns the longest duration (in seconds), zero without samples
+	double Max() const;
+
+	// Returns the mean duration (in seconds), zero without samples
+	double Mean() const;
+
+	// Returns the standard deviation (in seconds), zero without samples
+	double StdDev() const;
+
+	// Returns the duration below which a fraction of the samples fall (in seconds)
+	// @param p: the fraction in range of [0, 1], e.g. 0.99 for the 99th percentile
+	double Percentile(double p) const;
+
+	// Returns the buckets holding at least one sample, in increasing order
+	std::vector<Bucket> Histogram() const;
 
 private:
-	float timepoint;
+	static constexpr int sub_bits = 5, sub_buckets = 1 << sub_bits;
+	static constexpr int bucket_count = (64 - sub_bits) * sub_buckets;
+
+	std::array<std::uint64_t, bucket_count> buckets;
+	std::uint64_t count;
+	std::int64_t min, max;
+	double mean, m2; // running mean and sum of squared differences (Welford), in nanoseconds
+
+	// Returns the bucket of a duration
+	static int BucketIndex(std::uint64_t nanoseconds);
+
+	// Returns the lower bound of a bucket (in nanoseconds)
+	static std::uint64_t BucketLower(int index);
 };
 
-} // !Mathyw
\ No newline at end of file
+} // !Mathyw
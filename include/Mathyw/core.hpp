@@ -51,9 +51,11 @@
 
 // Mathyw C++ standard libraries dependencies
 #include <string>
+#include <cstring>
 #include <string_view>
 #include <array>
 #include <vector>
+#include <span>
 #include <unordered_map>
 #include <functional>
 #include <iostream>
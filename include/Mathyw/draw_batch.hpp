@@ -0,0 +1,80 @@
+#pragma once
+
+#include "./mesh_pool.hpp"
+
+namespace Mathyw {
+
+// Indirect draw command, laid out as OpenGL expects in GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand final
+{
+	std::uint32_t count, instance_count, first_index;
+	std::int32_t base_vertex;
+	std::uint32_t base_instance;
+};
+
+// Collects draws of meshes from one MeshPool and submits them together.
+// On OpenGL 4.3 (or with the multi-draw indirect, base instance and storage buffer extensions)
+// the whole batch is a single glMultiDrawElementsIndirect, otherwise it falls back to a loop of
+// glDrawElementsBaseVertex, which works on the default 3.3 context.
+//
+// The index of each draw is fed to the uint vertex attribute right after the pool layout,
+// use it to look up the per-draw data:
+// - indirect path: a std430 array in the shader storage block at the binding point
+// - fallback path: the uniform block at the binding point holds only the data of the current draw
+class DrawBatch
+{
+public:
+	// Initialize the batch
+	// @param pool: the pool that every mesh comes from
+	// @param data_size: size of the per-draw data in bytes (the std430 array stride), could be zero
+	// @param binding: binding point of the per-draw data block
+	DrawBatch(MeshPool& pool, std::uint32_t data_size = 0, std::uint32_t binding = 0);
+
+	// No copy construct allowed (use move instead)
+	DrawBatch(DrawBatch const&) = delete;
+
+	// No reassignment operator
+	DrawBatch& operator=(DrawBatch const&) = delete;
+
+	// Move constructor (transfer ownership)
+	DrawBatch(DrawBatch&&) noexcept;
+
+	// Destructor
+	~DrawBatch();
+
+	// Remove all draws, usually called once per frame
+	void Clear();
+
+	// Add a draw of an indexed mesh
+	// @param data: per-draw data, the size must equal to data_size in the constructor
+	void Add(Mesh mesh, std::span<std::byte const> data = {});
+
+	// Add a draw of an indexed mesh with a trivially copyable per-draw object
+	template<class Ty> requires std::is_trivially_copyable_v<Ty>
+	void Add(Mesh mesh, Ty const& data)
+	{
+		Add(mesh, std::span((std::byte const*)&data, sizeof(Ty)));
+	}
+
+	// Submit every draw in the batch
+	void Submit();
+
+	// Returns the commands built so far
+	inline std::vector<DrawElementsIndirectCommand> const& Commands() const { return commands; }
+
+	// Returns true if the current context supports the indirect path
+	static bool IndirectSupported();
+
+	// Always use the fallback path even if the indirect path is supported (for testing)
+	static void ForceFallback(bool enable);
+
+private:
+	MeshPool* pool;
+	std::uint32_t data_size, binding;
+	std::uint32_t command_buffer, data_buffer, id_buffer, id_capacity;
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<std::byte> data;
+	bool destruct_this;
+};
+
+} // !Mathyw
@@ -55,7 +55,7 @@ struct MouseMovedEvent : public Event
 struct MouseScrolledEvent : public Event
 {
 	MATHYW_EVENT_TYPE(3)
-		MouseScrolledEvent(Ivec2 position) : offset(offset) {}
+		MouseScrolledEvent(Ivec2 offset) : offset(offset) {}
 	Ivec2 offset; // mouse offset
 };
 
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "./event.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <variant>
+
+namespace Mathyw {
+
+// An application defined event, posted from any thread (see Window::Post)
+struct CustomEvent final
+{
+	std::uint32_t id; // identifies the kind of event, chosen by the application
+	std::uint64_t value; // any payload
+	void* data = nullptr; // any payload, owned by the application
+};
+
+// Any event of the queue, stored by value
+using QueuedEvent = std::variant<KeyEvent, MouseEvent, MouseMovedEvent, MouseScrolledEvent,
+	WindowFocusedEvent, WindowClosedEvent, WindowResizedEvent, WindowMovedEvent, CustomEvent>;
+
+// Combine lambdas into one handler, each lambda takes the event type it handles by const reference.
+// Events without a matching lambda are ignored.
+// e.g. EventHandlers{ [](KeyEvent const& e) { ... }, [](MouseMovedEvent const& e) { ... } }
+template<class... Fns>
+struct EventHandlers : Fns...
+{
+	using Fns::operator()...;
+};
+
+template<class... Fns>
+EventHandlers(Fns...) -> EventHandlers<Fns...>;
+
+// Bounded lock-free queue, any thread could push and one thread pops.
+// Each cell carries a sequence number telling whether it is free or filled (Vyukov),
+// producers only contend on the tail and never wait for each other.
+template<class Ty>
+class MPSCQueue final
+{
+public:
+	// Initialize the queue
+	// @param capacity: rounded up to a power of two
+	MPSCQueue(std::size_t capacity)
+		: cells(new Cell[std::bit_ceil(std::max<std::size_t>(capacity, 2))]),
+		mask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1), tail(0), head(0)
+	{
+		for (std::size_t i = 0; i <= mask; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	// Push a value, returns false if the queue is full. Could be called from any thread
+	bool Push(Ty const& value)
+	{
+		std::size_t pos = tail.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells[pos & mask];
+			auto diff = (std::intptr_t)cell.sequence.load(std::memory_order_acquire) - (std::intptr_t)pos;
+			if (diff < 0) return false; // the consumer has not freed the cell yet
+			if (diff > 0) pos = tail.load(std::memory_order_relaxed); // another producer took the cell
+			else if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				cell.value = value;
+				cell.sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+	}
+
+	// Pop a value, returns false if the queue is empty. Only called from the consumer thread
+	bool Pop(Ty& value)
+	{
+		Cell& cell = cells[head & mask];
+		if (cell.sequence.load(std::memory_order_acquire) != head + 1) return false;
+		value = std::move(cell.value);
+		cell.sequence.store(head + mask + 1, std::memory_order_release);
+		head++;
+		return true;
+	}
+
+private:
+	struct alignas(64) Cell final
+	{
+		std::atomic<std::size_t> sequence;
+		Ty value;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	std::size_t mask;
+	alignas(64) std::atomic<std::size_t> tail;
+	alignas(64) std::size_t head;
+};
+
+// Events stored by value in a fixed ring buffer and dispatched in a batch.
+// Consecutive mouse moves collapse into the latest position and consecutive scrolls add up,
+// so a high rate mouse costs one handler call per frame.
+class EventQueue final
+{
+public:
+	// Initialize the queue
+	// @param capacity: events held between two dispatches, further events are dropped except WindowClosedEvent
+	// @param custom_capacity: custom events posted from other threads between two dispatches
+	EventQueue(std::size_t capacity = 256, std::size_t custom_capacity = 256);
+
+	// Queue an event, merges it into the last one if both are moves or both are scrolls.
+	// Only called from the thread polling the events
+	void Push(QueuedEvent const& event);
+
+	// Queue a custom event, could be called from any thread.
+	// Returns false if the queue is full
+	inline bool Post(CustomEvent const& event) { return custom.Push(event); }
+
+	// Call the handler with every queued event in order, then the custom events, and empty the queue
+	template<class Handler>
+	void Dispatch(Handler&& handler)
+	{
+		auto visit = [&](auto const& event) {
+			if constexpr (std::is_invocable_v<Handler&, decltype(event)>) handler(event);
+		};
+		for (; count; count--, head = (head + 1) % ring.size())
+			std::visit(visit, ring[head]);
+		if (close_pending)
+		{
+			close_pending = false;
+			visit(WindowClosedEvent());
+		}
+		// custom events go to the handler straight from their own queue, they never take room in the ring
+		CustomEvent posted{};
+		while (custom.Pop(posted)) visit(posted);
+	}
+
+	// Returns the number of queued events
+	inline std::size_t Size() const { return count; }
+
+	// Returns the number of events merged into a previous one since the creation
+	inline std::uint64_t Coalesced() const { return coalesced; }
+
+	// Returns the number of events dropped because the queue was full since the creation
+	inline std::uint64_t Dropped() const { return dropped; }
+
+private:
+	std::vector<QueuedEvent> ring;
+	std::size_t head, count;
+	bool close_pending; // a WindowClosedEvent arrived while the ring was full
+	std::uint64_t coalesced, dropped;
+	MPSCQueue<CustomEvent> custom;
+};
+
+} // !Mathyw
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "./framebuffer.hpp"
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+
+namespace Mathyw {
+
+// A frame read back from the GPU, rows are ordered from top to bottom
+struct CapturedFrame final
+{
+	std::uint64_t index; // the number of frames captured before this one
+	Ivec2 size;
+	int channels; // 3 (RGB) or 4 (RGBA)
+	std::vector<std::uint8_t> pixels; // tightly packed rows
+};
+
+// Destination of captured frames, called on the worker threads of a FrameCapture
+struct FrameSink final
+{
+	std::function<bool(CapturedFrame const&)> write; // returns false if the frame could not be written
+	bool ordered = false; // frames must arrive in capture order (streams), limits the capture to one worker
+};
+
+// Writes raw pixels of each frame to a stream (e.g. a pipe opened with popen, or fdopen on a descriptor)
+// @param file: the stream, must outlive the capture
+FrameSink RawFrameSink(std::FILE* file);
+
+// Writes a YUV4MPEG2 stream (4:2:0, full range BT.601), readable by most video encoders
+// @param file: the stream, must outlive the capture
+// @param fps: frame rate written into the header
+FrameSink Y4MFrameSink(std::FILE* file, int fps);
+
+// Writes each frame to its own image file (".png" or ".qoi", see WriteImage), frames are encoded in parallel
+// @param pattern: path with a printf integer conversion for the frame index, e.g. "frames/%05d.png"
+FrameSink ImageSequenceSink(std::string const& pattern);
+
+// Counters of a FrameCapture
+struct CaptureStats final
+{
+	std::uint64_t captured = 0; // frames read back from the GPU
+	std::uint64_t written = 0; // frames passed to the sink
+	std::uint64_t failed = 0; // frames the sink could not write, included in written
+	std::uint64_t readback_stalls = 0; // waits for the GPU to finish a readback
+	std::uint64_t queue_stalls = 0; // waits for a free queue slot, the sink is slower than rendering
+};
+
+// Reads frames back without stalling the GPU and hands them to a sink on worker threads.
+// Each capture goes into one of a ring of pixel pack buffers and is collected once its fence is signaled,
+// a few frames later. The queue to the workers is bounded, Capture() blocks when it is full.
+class FrameCapture final
+{
+public:
+	// Initialize the pixel buffers and start the workers
+	// @param size: size of the captured region, from the bottom-left corner
+	// @param sink: where the frames go
+	// @param channels: 3 (RGB) or 4 (RGBA)
+	// @param queue_size: frames waiting for the sink at most
+	// @param threads: number of workers, uses the hardware concurrency minus one if zero
+	FrameCapture(Ivec2 size, FrameSink sink, int channels = 3, std::size_t queue_size = 8, unsigned threads = 0);
+
+	// No copy construct allowed
+	FrameCapture(FrameCapture const&) = delete;
+
+	// No reassignment operator
+	FrameCapture& operator=(FrameCapture const&) = delete;
+
+	// Write every frame captured, then stop the workers
+	~FrameCapture();
+
+	// Start reading a frame back, returns before the GPU has rendered it
+	// @param framebuffer: the framebuffer to read (resolved first with MSAA), nullptr for the current window
+	void Capture(Framebuffer* framebuffer = nullptr);
+
+	// Block until every frame captured is written by the sink
+	void Finish();
+
+	// Returns the counters
+	CaptureStats Stats() const;
+
+private:
+	static constexpr int ring_size = 3;
+
+	Ivec2 size;
+	int channels;
+	FrameSink sink;
+	std::size_t queue_size;
+	std::array<std::uint32_t, ring_size> pbos;
+	std::array<void*, ring_size> fences; // GLsync, nullptr if the buffer is not in flight
+	std::array<std::uint64_t, ring_size> indices; // frame index in each buffer
+	int head, in_flight;
+	std::uint64_t captured, readback_stalls, queue_stalls;
+
+	std::vector<std::thread> workers;
+	mutable std::mutex mutex;
+	std::condition_variable queue_changed;
+	std::deque<CapturedFrame> queue; // guarded by the mutex
+	std::vector<std::vector<std::uint8_t>> spare; // pixel vectors to reuse, guarded by the mutex
+	std::size_t busy; // frames being written, guarded by the mutex
+	std::atomic<std::uint64_t> written, failed;
+	bool stop;
+
+	// Copy the oldest readback into a frame and queue it, waits for its fence if needed
+	void Collect();
+
+	// Write frames until the capture is destroyed
+	void Work();
+};
+
+} // !Mathyw
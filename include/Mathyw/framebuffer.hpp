@@ -0,0 +1,75 @@
+#pragma once
+
+#include "./texture.hpp"
+#include "./color.hpp"
+
+namespace Mathyw {
+
+// Describes the attachments of a framebuffer
+struct FramebufferDesc final
+{
+	TextureFormat color = TextureFormat::RGBA8; // format of the color texture
+	bool depth = true; // attach a 24-bit depth and 8-bit stencil buffer
+	int samples = 0; // MSAA samples, zero renders straight into the color texture
+	TextureSampler sampler; // sampling of the color texture
+};
+
+// Offscreen render target, rendering does not need a visible window (see WindowHeadless).
+// With MSAA the scene is rendered into multisampled renderbuffers and resolved into the color texture.
+class Framebuffer final
+{
+public:
+	// Create the attachments
+	// @param size: size of every attachment in pixels
+	Framebuffer(Ivec2 size, FramebufferDesc const& desc = {});
+
+	// No copy construct allowed (use move instead)
+	Framebuffer(Framebuffer const&) = delete;
+
+	// No reassignment operator
+	Framebuffer& operator=(Framebuffer const&) = delete;
+
+	// Move constructor (transfer ownership)
+	Framebuffer(Framebuffer&&) noexcept;
+
+	// Destructor
+	~Framebuffer();
+
+	// Specify where to render, the viewport is set to cover the target
+	// @param framebuffer: could be nullptr to render into the current window
+	static void Bind(Framebuffer* framebuffer);
+
+	// Returns the current framebuffer binded, nullptr if rendering into the window
+	static Framebuffer* Current();
+
+	// Equivalent to Bind(this)
+	void Bind();
+
+	// Clear every attachment
+	void Clear(Fvec4 color = Black);
+
+	// Copy the multisampled image into the color texture, no effect without MSAA
+	void Resolve();
+
+	// Returns the color texture, call Resolve() first with MSAA
+	inline Texture& Color() { return color; }
+
+	// Returns the size of the attachments
+	inline Ivec2 Size() const { return size; }
+
+	// Returns the number of MSAA samples
+	inline int Samples() const { return samples; }
+
+private:
+	Texture color;
+	Ivec2 size;
+	int samples;
+	std::uint32_t fbo, resolve_fbo; // resolve_fbo holds the color texture, it equals to fbo without MSAA
+	std::uint32_t color_rb, depth_rb; // zero if not used
+	bool destruct_this;
+
+	// Friend classes
+	friend class FrameCapture;
+};
+
+} // !Mathyw
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "./texture.hpp"
+
+namespace Mathyw {
+
+// An image owning its pixels, rows are ordered from top to bottom
+struct Image final
+{
+	Ivec2 size;
+	int channels; // 1 to 4
+	std::vector<std::uint8_t> pixels; // tightly packed rows
+};
+
+// Pixels to be encoded, rows are ordered from top to bottom
+struct ImageView final
+{
+	std::uint8_t const* pixels;
+	Ivec2 size;
+	int channels; // 1 to 4
+	std::size_t row_pitch = 0; // bytes from one row to the next, tightly packed if zero
+
+	ImageView(std::uint8_t const* pixels, Ivec2 size, int channels, std::size_t row_pitch = 0)
+		: pixels(pixels), size(size), channels(channels), row_pitch(row_pitch ? row_pitch : std::size_t(size[0]) * channels) {}
+
+	ImageView(Image const& image)
+		: ImageView(image.pixels.data(), image.size, image.channels) {}
+};
+
+// Encode an image in the QOI format, expects 3 or 4 channels
+std::vector<std::uint8_t> EncodeQOI(ImageView image);
+
+// Encode an image in the PNG format.
+// The filtered rows are split into blocks deflated independently on separate threads,
+// each block ends byte aligned so they are simply concatenated into one zlib stream.
+// @param level: 0 stores the data uncompressed, 1 compresses with LZ77 and fixed Huffman codes
+// @param threads: number of blocks compressed in parallel, uses the hardware concurrency if zero
+std::vector<std::uint8_t> EncodePNG(ImageView image, int level = 1, unsigned threads = 0);
+
+// Encode and write an image, the format is chosen by the extension (".png" or ".qoi").
+// Returns false if the file cannot be written
+// @param threads: threads used by the PNG encoder, uses the hardware concurrency if zero
+bool WriteImage(std::string const& path, ImageView image, unsigned threads = 0);
+
+// Read the base level of a texture back (blocking), rows are flipped to be ordered from top to bottom
+Image ReadTexture(Texture& texture);
+
+} // !Mathyw
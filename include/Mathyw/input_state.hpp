@@ -0,0 +1,87 @@
+#pragma once
+
+#include "./vector.hpp"
+#include "./inputcode.hpp"
+#include <atomic>
+
+namespace Mathyw {
+
+// Keyboard and mouse state of a frame, with the changes since the previous frame.
+// A key pressed and released within one frame is both pressed and released, but not down.
+struct InputSnapshot final
+{
+	static constexpr int key_count = KeyMenu + 1, button_count = MouseButtonLast + 1;
+	using KeyBits = std::array<std::uint64_t, (key_count + 63) / 64>;
+
+	KeyBits keys{}, keys_pressed{}, keys_released{};
+	std::uint8_t buttons = 0, buttons_pressed = 0, buttons_released = 0;
+	Ivec2 mouse = Ivec2(0, 0); // cursor position, the origin is the top-left corner
+	Ivec2 scroll = Ivec2(0, 0); // scroll offset accumulated during the frame
+	std::uint64_t frame = 0; // how many snapshots were published before this one
+
+	// Returns true if the key is held down
+	inline bool KeyDown(KeyCode key) const { return Bit(keys, key); }
+
+	// Returns true if the key went down during the frame
+	inline bool KeyPressed(KeyCode key) const { return Bit(keys_pressed, key); }
+
+	// Returns true if the key went up during the frame
+	inline bool KeyReleased(KeyCode key) const { return Bit(keys_released, key); }
+
+	// Returns true if the mouse button is held down
+	inline bool ButtonDown(MouseButton button) const { return buttons >> button & 1; }
+
+	// Returns true if the mouse button went down during the frame
+	inline bool ButtonPressed(MouseButton button) const { return buttons_pressed >> button & 1; }
+
+	// Returns true if the mouse button went up during the frame
+	inline bool ButtonReleased(MouseButton button) const { return buttons_released >> button & 1; }
+
+	// Record a key going down or up, out of range keys are ignored
+	void Key(KeyCode key, bool down);
+
+	// Record a mouse button going down or up, out of range buttons are ignored
+	void Button(MouseButton button, bool down);
+
+	// Forget the changes of the frame, called after publishing it
+	void NextFrame();
+
+private:
+	static inline bool Bit(KeyBits const& bits, int key)
+	{
+		return key >= 0 && key < key_count && (bits[key / 64] >> (key % 64) & 1);
+	}
+};
+
+// Publishes input snapshots from the thread polling the events to any number of reading threads.
+// Snapshots go into a ring of slots, each guarded by a sequence number (seqlock).
+// The writer fills the slot after the latest one, so a reader copying the latest slot never
+// waits for the writer, it retries only if the writer lapped the whole ring during the copy.
+class InputState final
+{
+public:
+	// Initialize with an empty snapshot
+	InputState();
+
+	// Publish a snapshot, only called from one thread
+	void Publish(InputSnapshot const& snapshot);
+
+	// Returns the latest published snapshot, could be called from any thread
+	InputSnapshot Read() const;
+
+private:
+	static constexpr int slot_count = 4;
+	static constexpr std::size_t words = (sizeof(InputSnapshot) + 7) / 8;
+
+	// The snapshot is stored as relaxed atomic words, so a torn copy is detected instead of being undefined
+	struct Slot final
+	{
+		std::atomic<std::uint64_t> sequence; // odd while being written
+		std::array<std::atomic<std::uint64_t>, words> data;
+	};
+
+	std::array<Slot, slot_count> slots;
+	std::atomic<int> latest;
+};
+
+} // !Mathyw
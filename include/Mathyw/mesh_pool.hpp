@@ -0,0 +1,120 @@
+#pragma once
+
+#include "./vertex_array.hpp"
+
+namespace Mathyw {
+
+// Handle of a mesh allocated from a MeshPool
+struct Mesh final
+{
+	std::uint32_t id = ~0u;
+
+	// Returns true if the handle refers to a mesh
+	inline operator bool() const { return id != ~0u; }
+};
+
+// Ranges of a mesh inside the shared buffers of a MeshPool
+struct MeshRange final
+{
+	std::uint32_t vertex_offset, vertex_count; // in vertices
+	std::uint32_t index_offset, index_count; // in indices, zero if the mesh is not indexed
+};
+
+// Stores many small meshes of the same vertex layout in a few large buffers sharing one VAO.
+// Meshes are sub-allocated from the buffers, their indices are local to the mesh
+// and drawn with glDrawElementsBaseVertex, so drawing them only binds the VAO once.
+class MeshPool
+{
+public:
+	// Initialize the pool
+	// @param layout: the vertex layout shared by every mesh
+	// @param vertex_capacity: maximum number of vertices stored in the pool
+	// @param index_capacity: maximum number of indices stored in the pool
+	// @param type: index type on the GPU, expects Uint16 or Uint32 (each mesh must have fewer vertices than it can hold)
+	// @param primitive: primitive option for drawing
+	MeshPool(VertexLayout layout, std::uint32_t vertex_capacity, std::uint32_t index_capacity,
+		IndexType type = IndexType::Uint16, Primitives primitive = Primitives::Triangles);
+
+	// No copy construct allowed (use move instead)
+	MeshPool(MeshPool const&) = delete;
+
+	// No reassignment operator
+	MeshPool& operator=(MeshPool const&) = delete;
+
+	// Move constructor (transfer ownership)
+	MeshPool(MeshPool&&) noexcept = default;
+
+	// Allocate a mesh and upload its data, defragments the pool if there are no continuous space.
+	// Returns an empty handle if the pool is full.
+	// @param vertices: raw vertex data, the size must be a multiple of layout.stride
+	// @param indices: indices local to the mesh, could be empty if the mesh is not indexed
+	Mesh Add(std::span<std::byte const> vertices, std::span<unsigned const> indices = {});
+
+	// Allocate a mesh with container objects instead of raw bytes.
+	// @param vertices: the specific conatiner that has operator[] and size() defined
+	// @param indices: indices local to the mesh
+	template<ContainerType Ty>
+	Mesh Add(Ty&& vertices, std::span<unsigned const> indices = {})
+	{
+		std::size_t bytes = vertices.size() * sizeof(vertices[0]);
+		return Add(std::span((std::byte const*)&vertices[0], bytes), indices);
+	}
+
+	// Overwrite the vertex data of a mesh
+	// @param data: the new raw data, offset + data.size() must not exceed the mesh size
+	// @param offset: the number of bytes to skip at the beginning of the mesh
+	void Update(Mesh mesh, std::span<std::byte const> data, std::size_t offset = 0);
+
+	// Release a mesh, its handle becomes invalid
+	void Remove(Mesh mesh);
+
+	// Returns the ranges of the mesh inside the shared buffers, they change after Defragment()
+	MeshRange Range(Mesh mesh) const;
+
+	// Move every mesh to the front of the buffers, merging all free space into one block
+	void Defragment();
+
+	// Draw a single mesh
+	void Draw(Mesh mesh);
+
+	// Draw a list of meshes, the VAO is bound only once
+	void Draw(std::span<Mesh const> list);
+
+	// Returns the number of vertices and indices in use
+	inline std::uint32_t UsedVertices() const { return used_vertices; }
+	inline std::uint32_t UsedIndices() const { return used_indices; }
+
+private:
+	// First-fit free list over a range of elements, adjacent blocks are merged on release
+	struct FreeList final
+	{
+		struct Block final { std::uint32_t offset, count; };
+		std::vector<Block> blocks; // sorted by offset
+
+		// Returns the offset of the allocated block, or ~0u if there are no space
+		std::uint32_t Allocate(std::uint32_t count);
+
+		// Give back a block
+		void Free(std::uint32_t offset, std::uint32_t count);
+
+		// Returns the size of the largest free block
+		std::uint32_t Largest() const;
+	};
+
+	VertexArray vao;
+	VertexLayout layout;
+	std::uint32_t vertex_capacity, index_capacity, used_vertices, used_indices;
+	std::uint32_t index_size;
+	FreeList vertex_free, index_free;
+	std::vector<MeshRange> meshes;
+	std::vector<std::uint8_t> alive;
+	std::vector<std::uint32_t> free_ids;
+
+	// Draw a mesh, assumes the VAO is bound
+	void DrawRange(MeshRange const& range);
+
+	// Friend classes
+	friend class DrawBatch;
+};
+
+} // !Mathyw
@@ -18,4 +18,19 @@ void InitGL();
 // Multiple calls of this function would have no effects.
 void ExitGL();
 
+// Request the OpenGL core version of the contexts created afterwards (3.3 by default).
+// Newer versions unlock optional paths such as multi-draw indirect on 4.3,
+// a window falls back to 3.3 if the requested version cannot be created.
+void GLContextVersion(int major, int minor);
+
+// Returns true if the current context is at least the specific version
+bool GLSupports(int major, int minor);
+
+// Returns true if the current context supports the extension (e.g. "GL_ARB_multi_draw_indirect")
+bool GLSupports(char const* extension);
+
+// Returns the address of an OpenGL function, nullptr if the current context does not provide it.
+// Only OpenGL 3.3 functions are loaded by glad, newer ones must be obtained through this function.
+void* GLProcAddress(char const* name);
+
 } // !Mathyw
\ No newline at end of file
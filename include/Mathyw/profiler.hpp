@@ -0,0 +1,178 @@
+#pragma once
+
+#include "./color.hpp"
+#include "./font.hpp"
+#include "./shader.hpp"
+#include "./vertex_array.hpp"
+
+namespace Mathyw {
+
+// Timings of a named scope over the recent frames (in milliseconds).
+// The times of a frame are the sum of every call of the scope in the frame.
+struct ProfileStats final
+{
+	std::string_view name; // valid until a new scope name is measured
+	std::uint32_t depth = 0; // nesting level of the first call, zero for the frame
+	std::uint32_t calls = 0; // calls in the latest resolved frame
+	double cpu = 0.0, gpu = 0.0; // latest resolved frame
+	double cpu_p50 = 0.0, cpu_p95 = 0.0, cpu_p99 = 0.0;
+	double gpu_p50 = 0.0, gpu_p95 = 0.0, gpu_p99 = 0.0;
+};
+
+// Measures named CPU and GPU scopes of every frame.
+// GPU times come from timer queries kept in a ring of frames, a frame is read back
+// only once every query of it is available so the profiler never stalls the pipeline.
+// Use it on the thread owning the context, between BeginFrame() and EndFrame().
+class Profiler final
+{
+public:
+	// Guard of a scope, ends it on destruction
+	class Scope final
+	{
+	public:
+		Scope(Profiler& profiler, std::string_view name, bool gpu)
+			: profiler(profiler) { profiler.Begin(name, gpu); }
+
+		Scope(Scope const&) = delete;
+		Scope& operator=(Scope const&) = delete;
+		~Scope() { profiler.End(); }
+
+	private:
+		Profiler& profiler;
+	};
+
+	// Initialize the profiler
+	// @param history: how many frames the percentiles are computed from
+	// @param latency: how many frames of queries are in flight before the oldest is dropped
+	Profiler(std::size_t history = 240, int latency = 4);
+
+	// No copy construct allowed (use move instead)
+	Profiler(Profiler const&) = delete;
+
+	// No reassignment operator
+	Profiler& operator=(Profiler const&) = delete;
+
+	// Move constructor (transfer ownership)
+	Profiler(Profiler&&) noexcept;
+
+	// Destructor
+	~Profiler();
+
+	// Returns true if the context supports timer queries, otherwise only CPU times are measured
+	static bool GPUSupported();
+
+	// Start a frame, reads back every finished frame in flight.
+	// The frame itself is measured as a scope named "Frame".
+	void BeginFrame();
+
+	// End the frame, every scope begun in it must be ended
+	void EndFrame();
+
+	// Begin a scope, scopes could be nested
+	// @param gpu: false to measure only the CPU time
+	void Begin(std::string_view name, bool gpu = true);
+
+	// End the innermost scope
+	void End();
+
+	// Measure a scope until the returned guard is destroyed
+	// @param gpu: false to measure only the CPU time
+	inline Scope Measure(std::string_view name, bool gpu = true) { return Scope(*this, name, gpu); }
+
+	// Returns the statistics of every scope in the order they first appeared
+	std::vector<ProfileStats> Stats() const;
+
+	// Returns the number of frames dropped because their queries were not available in time
+	inline std::uint64_t Dropped() const { return dropped; }
+
+	// Start recording the resolved frames for WriteTrace, discards the previous recording
+	// @param max_events: recording stops once this many scopes are recorded
+	void StartTrace(std::size_t max_events = 1 << 20);
+
+	// Stop recording
+	inline void StopTrace() { tracing = false; }
+
+	// Write the recording as Chrome trace event JSON (chrome://tracing or Perfetto),
+	// CPU scopes are on thread 1 and GPU scopes on thread 2 of the same time line.
+	// Returns false if the file cannot be written
+	bool WriteTrace(std::string const& path) const;
+
+private:
+	// A call of a scope
+	struct Event final
+	{
+		std::uint32_t name;
+		std::int64_t cpu_begin, cpu_end; // nanoseconds
+		int gpu_begin, gpu_end; // indices of the timestamp queries in the frame, -1 for CPU only
+	};
+
+	// A frame in flight, its queries are reused when the ring comes back to it
+	struct Frame final
+	{
+		std::vector<Event> events;
+		std::vector<std::uint32_t> queries;
+		std::uint32_t used = 0;
+		std::int64_t gpu_offset = 0; // cpu time minus gpu time, aligns the two time lines
+		bool pending = false;
+	};
+
+	// Rolling per-frame times of a scope
+	struct History final
+	{
+		std::string name;
+		std::uint32_t depth, calls;
+		std::vector<float> cpu, gpu; // rings of `history` frames
+	};
+
+	// A recorded scope of the trace
+	struct TraceEvent final
+	{
+		std::uint32_t name;
+		bool gpu;
+		std::int64_t begin, end; // nanoseconds on the cpu time line
+	};
+
+	std::vector<Frame> frames;
+	std::size_t frame_index, history, history_count;
+	std::vector<History> scopes;
+	std::unordered_map<std::uint64_t, std::uint32_t> scope_ids; // name hash to index of scopes
+	std::vector<std::uint32_t> stack; // open events of the current frame
+	std::vector<TraceEvent> trace;
+	std::size_t max_trace;
+	std::uint64_t dropped;
+	bool gpu_enabled, tracing, destruct_this;
+
+	// Returns the frame being recorded
+	inline Frame& Current() { return frames[frame_index % frames.size()]; }
+
+	// Returns the index of a scope, registers the name on first use
+	std::uint32_t ScopeId(std::string_view name, std::uint32_t depth);
+
+	// Issue a timestamp query, returns its index in the frame
+	int Timestamp(Frame& frame);
+
+	// Read back the frame if its queries are available, returns false if they are not
+	bool Resolve(Frame& frame);
+};
+
+// Draws the statistics of a profiler as text at the top left corner of the viewport
+class ProfilerOverlay final
+{
+public:
+	// Initialize the overlay
+	// @param font: the font of the text, must outlive the overlay
+	ProfilerOverlay(Font& font);
+
+	// Draw the statistics onto the bound framebuffer, enables blending while drawing
+	// @param viewport: the size of the framebuffer in pixels
+	// @param color: the color of the text
+	void Draw(Profiler const& profiler, Ivec2 viewport, Fvec4 color = White);
+
+private:
+	Font& font;
+	Shader shader;
+	VertexArray quad;
+	std::vector<Text> lines;
+};
+
+} // !Mathyw
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "./window.hpp"
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace Mathyw {
+
+// The rendering work of a frame, recorded by the simulation and replayed on the render thread.
+// Commands capture what they draw by value (matrices, strings, shared_ptr to resources),
+// so the simulation could change its state while the render thread draws the previous frame.
+class RenderPacket final
+{
+public:
+	// Record a command, it is called on the render thread with the context current
+	template<class Fn>
+	void Add(Fn&& command) { commands.emplace_back(std::forward<Fn>(command)); }
+
+	// Returns the number of recorded commands
+	inline std::size_t Size() const { return commands.size(); }
+
+	// Remove every command, the storage is kept for the next frame
+	inline void Clear() { commands.clear(); }
+
+private:
+	std::vector<std::function<void()>> commands;
+
+	// Friend classes
+	friend class RenderThread;
+};
+
+// Moves the OpenGL context of a window to a dedicated thread that replays render packets.
+//
+// Threads:
+//	- main thread: polls events (Window::PollEvents or WaitEvents, then PublishInput), GLFW requires it
+//	- simulation: any one thread, reads Window::Input() or queued events, records Packet() and calls Submit()
+//	- render thread: owns the context, replays the packets and swaps buffers
+//
+// Ownership: Shader, Texture, VertexArray and every other OpenGL object must be created, used and
+// destroyed on the render thread. Create<Ty>() constructs one there and returns a shared_ptr whose
+// deleter sends the destruction back to the render thread, so commands could capture the shared_ptr
+// and the object lives until the last packet using it is done. Every such object must be released
+// before the RenderThread is destroyed.
+//
+// While it runs, the main thread must not call the Window functions issuing OpenGL calls
+// (Clear, Viewport, Present, Update, Vsync, FramesInFlight), record them in packets instead.
+class RenderThread final
+{
+public:
+	// Start the render thread and make the context of the window current on it
+	RenderThread(Window& window);
+
+	// No copy construct allowed
+	RenderThread(RenderThread const&) = delete;
+
+	// No reassignment operator
+	RenderThread& operator=(RenderThread const&) = delete;
+
+	// Replay the submitted packet, stop the thread and give the context back to the calling thread
+	~RenderThread();
+
+	// Returns the packet being recorded
+	inline RenderPacket& Packet() { return packets[recording]; }
+
+	// Hand the recorded packet to the render thread and start recording the other one.
+	// Waits if the render thread has not finished the previous packet yet,
+	// so the simulation runs at most one frame ahead of the rendering
+	void Submit();
+
+	// Run a function on the render thread and wait for its result
+	template<class Fn>
+	auto Invoke(Fn&& fn) -> std::invoke_result_t<Fn&>
+	{
+		if (OnRenderThread()) return fn();
+		auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Fn&>()>>(std::forward<Fn>(fn));
+		auto result = task->get_future();
+		Post([task] { (*task)(); });
+		return result.get();
+	}
+
+	// Construct an OpenGL object on the render thread, it is destroyed on the render thread as well
+	template<class Ty, class... Args>
+	std::shared_ptr<Ty> Create(Args&&... args)
+	{
+		Ty* object = Invoke([&] { return new Ty(std::forward<Args>(args)...); });
+		return std::shared_ptr<Ty>(object, [this](Ty* object) {
+			Destroy([object] { delete object; });
+		});
+	}
+
+	// Returns true if called from the render thread
+	inline bool OnRenderThread() const { return std::this_thread::get_id() == render_id; }
+
+	// Returns how many packets were replayed
+	inline std::uint64_t Frames() const { return frames; }
+
+private:
+	Window& window;
+	std::array<RenderPacket, 2> packets;
+	int recording; // index of the packet being recorded
+	bool submitted, stop; // a packet is waiting for or being replayed, the thread should exit
+	std::deque<std::function<void()>> tasks; // Invoke and Destroy requests
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	std::atomic<std::uint64_t> frames;
+	std::atomic<std::thread::id> render_id;
+	std::thread thread;
+
+	// Queue a task for the render thread
+	void Post(std::function<void()> task);
+
+	// Destroy an object on the render thread, right away if already on it
+	void Destroy(std::function<void()> destroy);
+
+	// The loop of the render thread
+	void Loop();
+};
+
+} // !Mathyw
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "./window.hpp"
+#include "./clock.hpp"
+
+namespace Mathyw {
+
+// How the Run loop schedules frames
+enum class RunMode
+{
+	Continuous,	// draw frames back to back, paced by the frame rate or vsync
+	OnDemand	// sleep in WaitEvents until an event arrives, a ValueTracker is active or a redraw is requested
+};
+
+// Configuration of the Run loop
+struct RunConfig final
+{
+	RunMode mode = RunMode::Continuous;
+	double update_rate = 60.0; // fixed simulation steps per second, zero to update once per frame with the frame time
+	double frame_rate = 0.0; // frames per second, zero to draw as fast as the swap interval allows
+	int max_steps = 8; // simulation steps per frame at most, the rest of a long frame is dropped
+	double spin = 0.002; // the end of every frame wait is spun instead of slept (in seconds), covers the sleep overshoot
+	double idle_timeout = 0.0; // the longest sleep of the on-demand mode (in seconds), zero to sleep without limit
+	FrameStats* stats = nullptr; // receives the time between two frames if not nullptr
+};
+
+// Run the window until it is closed.
+// Each frame polls the events, calls update once per fixed step that elapsed,
+// then calls render, swaps buffers and waits for the frame rate.
+// With Window::LowLatency the events are polled just in time for the next vertical blank.
+// @param update: advances the simulation, receives the step (in seconds)
+// @param render: draws the frame, receives how far the time is between the last step and the next one in range of [0, 1),
+//		used to interpolate the simulation states (always zero without a fixed update rate)
+void Run(Window& window, RunConfig const& config,
+	std::function<void(double)> const& update, std::function<void(double)> const& render);
+
+// Sleep the thread until the time point of Clock::Now(), sleeps coarsely then spins for precision
+// @param spin: how long before the time point the sleep stops and the spin starts (in seconds)
+void SleepUntil(std::int64_t timepoint, double spin = 0.002);
+
+} // !Mathyw
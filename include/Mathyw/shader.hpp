@@ -1,16 +1,69 @@
 #pragma once
 
 #include "./vector.hpp"
+#include "./uniform_buffer.hpp"
 
 namespace Mathyw {
 
+// FNV-1a hash of a string, usable at compile time
+// @param hash: the hash to continue from, allows hashing multiple strings as one
+constexpr std::uint64_t HashString(std::string_view str, std::uint64_t hash = 0xcbf29ce484222325ull)
+{
+	for (char c : str)
+		hash = (hash ^ (std::uint8_t)c) * 0x100000001b3ull;
+	return hash;
+}
+
+// Identifies a uniform by the hash of its name.
+// The name is hashed at compile time when a string literal is passed.
+struct UniformId final
+{
+	// Hash a string literal (or a constexpr char array) at compile time
+	template<std::size_t N>
+	consteval UniformId(char const (&name)[N])
+		: hash(HashString(name)), name(name) {}
+
+	// Hash a name written in a char buffer at runtime (e.g. with snprintf),
+	// the buffer must outlive the first use of the id
+	template<std::size_t N>
+	UniformId(char (&name)[N])
+		: UniformId(std::string_view(name)) {}
+
+	// Hash a C string at runtime, the string must outlive the first use of the id.
+	// A template so string literals still prefer the compile time constructor
+	template<class Ptr> requires (std::is_same_v<Ptr, char const*> || std::is_same_v<Ptr, char*>)
+	UniformId(Ptr const& name)
+		: UniformId(std::string_view(name)) {}
+
+	// Hash a name at runtime, the string must outlive the first use of the id
+	UniformId(std::string_view name)
+		: hash(HashString(name)), name(name) {}
+
+	// Hash a name at runtime, the string must outlive the first use of the id
+	UniformId(std::string const& name)
+		: UniformId(std::string_view(name)) {}
+
+	std::uint64_t hash;
+	std::string_view name;
+};
+
+// How a shader waits for its compilation
+enum class ShaderCompile
+{
+	Blocking,	// compile and link before the constructor returns
+	Async		// issue the compilation and link, query the result only when needed
+};
+
 // Allows user to manage OpenGL shader.
-// Supports shader source loading (version 330 core), bindings and uniforms
+// Supports shader source loading (version 330 core), bindings and uniforms.
+// Remembers the value of each uniform, setting an unchanged value costs no driver call.
 class Shader
 {
 public:
 	// Initialize with a shader source (vertex shader and fragment shader)
-	Shader(std::string const& vertex, std::string const& fragment);
+	// @param compile: Async lets the driver compile while the program does other work,
+	//		the shader waits for the result on first use (see Ready() and Wait())
+	Shader(std::string const& vertex, std::string const& fragment, ShaderCompile compile = ShaderCompile::Blocking);
 
 	// No copy construct allowed (use move instead)
 	Shader(Shader const&) = delete;
@@ -24,11 +77,18 @@ public:
 	// Destructor
 	~Shader();
 
-	// Return true if no error occurred
-	inline operator bool() const { return good; }
+	// Return true if no error occurred, waits for an async compilation
+	inline operator bool() const { Wait(); return good; }
+
+	// The error message OpenGL reported, empty if no errors, waits for an async compilation
+	inline std::string_view ErrorMessage() const { Wait(); return err_message; }
 
-	// The error message OpenGL reported, empty if no errors
-	inline std::string_view ErrorMessage() const { return err_message; }
+	// Returns true if the compilation is finished, never blocks with GL_KHR_parallel_shader_compile.
+	// Without the extension the driver cannot be polled, the compilation is finished (blocking) instead.
+	bool Ready() const;
+
+	// Block until the compilation is finished
+	inline void Wait() const { if (pending) Finish(); }
 
 	// Specify which shader to use
 	// @param shader: could be nullptr if no shader are used
@@ -44,35 +104,89 @@ public:
 	// @param name: the name of the uniform
 	// @param vec: Type could be int, unsigned int or float, size could be 1 to 4
 	template<class Ty, std::uint8_t Sz>
-	void Uniform(std::string const& name, Vector<Ty, Sz> const& vec);
+	void Uniform(UniformId name, Vector<Ty, Sz> const& vec);
 
 	// Set a uniform matrix
 	// @param name: the name of the uniform
 	// @param mat: Type must be float, rows and columns could be 1 to 4
 	template<std::uint8_t R, std::uint8_t C>
-	void Uniform(std::string const& name, Matrix<float, R, C> const& mat);
+	void Uniform(UniformId name, Matrix<float, R, C> const& mat);
 
 	// Set uniform, it follows the implementation of uniform vectors
 	// @param name: the name of the uniform
 	// @param args: sizeof...(args) must be 1 to 4
 	template<ArithmeticType... Tys>
-	void Uniform(std::string const& name, Tys... args)
+	void Uniform(UniformId name, Tys... args)
 	{
 		Vector<std::common_type_t<Tys...>, sizeof...(Tys)> vec = { args... };
 		Uniform(name, vec);
 	}
 
+	// Returns the location of the uniform, -1 if the uniform does not exist
+	int UniformLocation(UniformId name);
+
+	// Bind a uniform block to a binding point
+	// @param name: the name of the uniform block
+	// @param binding: the binding point, shared with a UniformBuffer
+	void UniformBlock(std::string_view name, std::uint32_t binding);
+
+	// Bind a uniform block to the binding point of a uniform buffer
+	// @param name: the name of the uniform block
+	inline void UniformBlock(std::string_view name, UniformBufferBase const& buffer) { UniformBlock(name, buffer.Binding()); }
+
 protected:
-	std::uint32_t shaderid;
-	std::unordered_map<std::string, int> uniform_location_cache;
-	bool good, destruct_this;
-	std::string err_message;
+	// Last value set to a uniform location, size is zero if nothing is set
+	struct UniformValue final { std::array<std::byte, 64> data; std::uint8_t size; };
 
-	// Returns the location of the uniform
-	int UniformLocation(std::string const& name);
+	// A slot of the uniform location table, hash is zero if the slot is empty
+	struct UniformSlot final { std::uint64_t hash; int location; };
+
+	// The compilation state is mutable, waiting for an async compilation does not change the shader
+	std::uint32_t shaderid;
+	mutable std::array<std::uint32_t, 2> stages; // vertex and fragment shader, kept until the compilation is finished
+	mutable std::string binary_path; // where to store the program binary once linked, empty if not cached
+	mutable bool pending;
+	mutable std::vector<UniformSlot> uniform_location_cache; // open addressing, the size is a power of two
+	mutable std::uint32_t uniform_count;
+	std::vector<UniformValue> uniform_values; // indexed by location
+	mutable bool good;
+	bool destruct_this;
+	mutable std::string err_message;
+
+	// Store the location of the uniform in the table
+	void CacheUniformLocation(std::uint64_t hash, int location) const;
+
+	// Query the compilation results and resolve the uniforms
+	void Finish() const;
+
+	// Check the link status and fill the table with every active uniform of the linked program
+	void ResolveUniforms() const;
+
+	// Returns true if the location already holds the value, otherwise remembers it
+	bool UniformUnchanged(int location, void const* value, std::size_t size);
 };
 
 // Read shaders from files (vertex shader and fragment shader)
-Shader ReadShaderFile(std::string const& vertex, std::string const& fragment);
+Shader ReadShaderFile(std::string const& vertex, std::string const& fragment, ShaderCompile compile = ShaderCompile::Blocking);
+
+// Counters of shader creation, useful to measure the startup time
+struct ShaderCacheStats final
+{
+	std::uint32_t hits = 0; // programs loaded from cached binaries
+	std::uint32_t misses = 0; // programs compiled while the cache is enabled
+	std::uint32_t rejected = 0; // cached binaries refused by the driver (e.g. after a driver update)
+	double load_seconds = 0.0; // time spent loading cached binaries
+	double compile_seconds = 0.0; // time spent waiting for compilation and linking from source
+};
+
+// Enable the on-disk program binary cache for shaders constructed afterwards.
+// Binaries are keyed by a hash of the sources and the driver (vendor, renderer and version),
+// shaders fall back to compiling from source if a binary is missing or refused.
+// Requires OpenGL 4.1 or GL_ARB_get_program_binary, otherwise the cache stays unused.
+// @param directory: where the binaries are stored, empty to disable the cache
+void ShaderCacheDirectory(std::string const& directory);
+
+// Returns the counters of shader creation
+ShaderCacheStats const& ShaderCacheStatistics();
 
 } // !Mathyw
\ No newline at end of file
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "./shader.hpp"
+
+namespace Mathyw {
+
+// A macro injected into a shader source as "#define name value"
+struct ShaderDefine final
+{
+	std::string name, value;
+};
+
+// Expand the #include directives of a shader source and inject defines.
+// Included paths are relative to the directory, each file is included at most once.
+// Defines are injected after the #version line, #line directives keep error line numbers.
+// @param directory: where the paths of #include "path" are resolved from
+// @param defines: macros visible to the source and every included file
+std::string PreprocessShader(std::string const& source, std::string const& directory, std::span<ShaderDefine const> defines = {});
+
+// Read a shader file and preprocess it, includes are resolved relative to the file
+std::string PreprocessShaderFile(std::string const& file, std::span<ShaderDefine const> defines = {});
+
+// Compiles each permutation of a shader (files and defines) once.
+// Each stage only receives the defines its code (includes expanded) refers to, so permutations
+// differing by unused defines share one program, and therefore its uniform location cache and values.
+class ShaderVariants final
+{
+public:
+	// Initialize an empty registry
+	// @param compile: how the programs are compiled (see ShaderCompile)
+	ShaderVariants(ShaderCompile compile = ShaderCompile::Blocking);
+
+	// Returns the program of the files with the defines, compiled on first request.
+	// The order of the defines does not matter.
+	// @param vertex: path of the vertex shader
+	// @param fragment: path of the fragment shader
+	Shader& Get(std::string const& vertex, std::string const& fragment, std::span<ShaderDefine const> defines = {});
+
+	// Returns the number of distinct permutations requested
+	inline std::size_t VariantCount() const { return variants.size(); }
+
+	// Returns the number of programs compiled
+	inline std::size_t ProgramCount() const { return programs.size(); }
+
+	// Destroy every program and forget the files read, shader references become invalid
+	void Clear();
+
+private:
+	ShaderCompile compile;
+	std::unordered_map<std::string, Shader*> variants; // files and sorted defines to program
+	std::unordered_map<std::string, std::unique_ptr<Shader>> programs; // expanded sources with the used defines to program
+	std::unordered_map<std::string, std::string> files; // contents of the files and includes read so far
+};
+
+} // !Mathyw
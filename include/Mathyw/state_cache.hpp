@@ -0,0 +1,120 @@
+#pragma once
+
+#include "./vector.hpp"
+
+namespace Mathyw {
+
+// Counters of OpenGL calls that went through the state cache
+struct GLStateStats final
+{
+	std::uint64_t issued = 0; // calls that reached the driver
+	std::uint64_t skipped = 0; // redundant calls that were dropped
+};
+
+// Mirrors the OpenGL state of a context so that setting a state that is already set costs no driver call.
+// Every Mathyw object changes bindings and capabilities through the cache of the current context,
+// call Invalidate() after changing them with raw OpenGL calls.
+class GLStateCache final
+{
+public:
+	// Initialize the cache with the default state of a new context
+	GLStateCache();
+
+	// Returns the cache of the context current on this thread
+	static GLStateCache& Current();
+
+	// Switch the cache of this thread to the context, called when a context is made current
+	// @param context: the GLFWwindow of the context, could be nullptr
+	static void MakeCurrent(void* context);
+
+	// Discard the cache of a context that is going to be destroyed
+	static void Destroy(void* context);
+
+	// Forget every cached value, the next call of each state always reaches the driver
+	void Invalidate();
+
+	// glUseProgram
+	void UseProgram(std::uint32_t program);
+
+	// glBindVertexArray, the element array buffer binding follows the vao
+	void BindVertexArray(std::uint32_t vao);
+
+	// glBindBuffer
+	void BindBuffer(std::uint32_t target, std::uint32_t buffer);
+
+	// glBindBufferBase, also changes the generic binding of the target
+	void BindBufferBase(std::uint32_t target, std::uint32_t index, std::uint32_t buffer);
+
+	// glBindBufferRange, also changes the generic binding of the target
+	void BindBufferRange(std::uint32_t target, std::uint32_t index, std::uint32_t buffer, std::size_t offset, std::size_t size);
+
+	// glBindFramebuffer, GL_FRAMEBUFFER binds both the draw and read framebuffer
+	void BindFramebuffer(std::uint32_t target, std::uint32_t framebuffer);
+
+	// glActiveTexture, expects the index of the unit instead of GL_TEXTURE0 + unit
+	void ActiveTexture(int unit);
+
+	// glBindTexture on a specific unit
+	void BindTexture(int unit, std::uint32_t target, std::uint32_t texture);
+
+	// glBindTexture on the active unit
+	void BindTexture(std::uint32_t target, std::uint32_t texture);
+
+	// glEnable or glDisable
+	void Capability(std::uint32_t cap, bool enable);
+
+	// Returns true if the capability is enabled
+	bool IsEnabled(std::uint32_t cap) const;
+
+	// glBlendFunc
+	void BlendFunc(std::uint32_t src, std::uint32_t dst);
+
+	// glViewport
+	void Viewport(Ivec4 viewport);
+
+	// glScissor
+	void Scissor(Ivec4 box);
+
+	// Remove deleted objects from the cache, since OpenGL unbinds them on deletion
+	void ProgramDeleted(std::uint32_t program);
+	void VertexArrayDeleted(std::uint32_t vao);
+	void BufferDeleted(std::uint32_t buffer);
+	void TextureDeleted(std::uint32_t texture);
+	void FramebufferDeleted(std::uint32_t framebuffer);
+
+	// Returns the counters accumulated since the last reset
+	inline GLStateStats const& Stats() const { return stats; }
+
+	// Reset the counters, usually called once per frame
+	inline void ResetStats() { stats = GLStateStats(); }
+
+private:
+	static constexpr std::uint32_t unknown = ~0u;
+	static constexpr int texture_units = 32, buffer_targets = 9, indexed_bindings = 32;
+
+	// An indexed buffer binding, size is zero for the whole buffer
+	struct IndexedBinding final { std::uint32_t buffer; std::size_t offset, size; };
+
+	std::uint32_t program, vao;
+	std::uint32_t draw_framebuffer, read_framebuffer;
+	std::array<std::uint32_t, buffer_targets> buffers;
+	std::array<std::array<IndexedBinding, indexed_bindings>, 2> indexed; // uniform and shader storage
+	int active_unit;
+	std::array<std::uint32_t, texture_units> textures; // GL_TEXTURE_2D only, other targets are not cached
+	std::uint32_t enabled, known; // bit masks of capabilities
+	std::uint32_t blend_src, blend_dst;
+	Ivec4 viewport, scissor;
+	GLStateStats stats;
+
+	// Returns true (and counts a skipped call) if the value is already set, otherwise stores it
+	template<class Ty>
+	bool Cached(Ty& slot, Ty const& value)
+	{
+		if (slot == value) { stats.skipped++; return true; }
+		slot = value;
+		stats.issued++;
+		return false;
+	}
+};
+
+} // !Mathyw
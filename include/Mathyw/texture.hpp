@@ -4,19 +4,80 @@
 
 namespace Mathyw {
 
+struct Image;
+
+// Internal format of a texture
+enum class TextureFormat
+{
+	Auto,		// the smallest 8-bit format holding every channel of the data
+	R8,
+	RG8,
+	RGB8,
+	RGBA8,
+	SRGB8,		// RGB with sRGB encoding, sampled as linear values
+	SRGB8A8,	// RGBA with sRGB encoded color and linear alpha
+	R16F		// single channel half float
+};
+
+// Texture filtering
+enum class TextureFilter
+{
+	Nearest,
+	Linear
+};
+
+// Texture coordinate wrapping
+enum class TextureWrap
+{
+	Repeat,
+	MirroredRepeat,
+	ClampToEdge,
+	ClampToBorder
+};
+
+// How the mipmaps of a texture are built
+enum class MipmapMode
+{
+	None,	// a single level
+	GPU,	// glGenerateMipmap
+	CPU		// box filter on worker threads, sRGB textures are filtered in linear space
+};
+
+// Sampling state of a texture
+struct TextureSampler final
+{
+	TextureFilter min_filter = TextureFilter::Linear;
+	TextureFilter mag_filter = TextureFilter::Linear;
+	TextureFilter mip_filter = TextureFilter::Linear; // between mipmap levels, ignored without mipmaps
+	TextureWrap wrap_s = TextureWrap::Repeat;
+	TextureWrap wrap_t = TextureWrap::Repeat;
+	float anisotropy = 1.0f; // ignored if GL_EXT_texture_filter_anisotropic is not supported
+};
+
+// Describes how a texture is stored and sampled
+struct TextureDesc final
+{
+	TextureFormat format = TextureFormat::Auto;
+	MipmapMode mipmaps = MipmapMode::None;
+	TextureSampler sampler;
+};
+
 // Stores texture for OpenGL shader bindings.
+// The storage is immutable (glTexStorage2D) where OpenGL 4.2 or GL_ARB_texture_storage is supported.
 class Texture final
 {
 public:
 	// Pass the image data into this texture
-	// @param data: the array pointer of image
+	// @param data: the array pointer of image, rows are tightly packed, could be nullptr
 	// @param size: size of that image
 	// @param channels: number of channels of image, expects 1 to 4
-	Texture(std::uint8_t const* data, Ivec2 size, int channels);
+	// @param desc: format, mipmaps and sampling of the texture
+	Texture(std::uint8_t const* data, Ivec2 size, int channels, TextureDesc const& desc = {});
 
-	// Directly load the texture from file
+	// Directly load the texture from file (see TextureLoader to load without blocking)
 	// @param channels: number of channels to be loaded (1 to 4), uses default if zero
-	Texture(std::string const& path, int channels = 0);
+	// @param desc: format, mipmaps and sampling of the texture
+	Texture(std::string const& path, int channels = 0, TextureDesc const& desc = {});
 
 	// No copy construct allowed (use move instead)
 	Texture(Texture const&) = delete;
@@ -38,13 +99,64 @@ public:
 	// Equivalent to Bind(this, slot)
 	void Bind(int slot = 0);
 
+	// Change the sampling state
+	void SetSampler(TextureSampler const& sampler);
+
+	// Replace a region of pixels without waiting for the transfer.
+	// The data is copied into one of a ring of pixel buffers, the GPU reads it asynchronously,
+	// a buffer is reused once the fence of its previous transfer is signaled. Mipmaps are not rebuilt.
+	// @param region: x, y, width and height of the region in pixels
+	// @param data: pixels with the same channels as the texture
+	// @param row_pitch: bytes from one row of the data to the next, tightly packed if zero
+	// @param level: the mipmap level to update
+	void Update(Ivec4 region, std::uint8_t const* data, std::size_t row_pitch = 0, int level = 0);
+
 	// Returns the size of the texture
 	inline Ivec2 Size() const { return size; }
 
+	// Returns the internal format
+	inline TextureFormat Format() const { return format; }
+
+	// Returns the number of channels of the pixel data
+	inline int Channels() const { return channels; }
+
+	// Returns the number of mipmap levels
+	inline int Levels() const { return levels; }
+
+	// Returns the bytes of video memory the texture occupies (as requested, drivers may pad RGB formats)
+	inline std::size_t ByteSize() const { return bytes; }
+
+	// Returns the bytes of every texture alive
+	static std::size_t TotalByteSize();
+
 private:
+	friend class TextureLoader;
+	friend class Framebuffer;
+	friend Image ReadTexture(Texture& texture);
+
 	std::uint32_t textureid;
 	Ivec2 size;
+	TextureFormat format;
+	MipmapMode mipmaps;
+	int levels, channels;
+	std::size_t bytes;
+	std::array<std::uint32_t, 3> pbos; // ring of pixel unpack buffers, created on first update
+	std::array<std::size_t, 3> pbo_sizes;
+	std::array<void*, 3> fences; // GLsync of the last transfer from each buffer
+	int pbo_index;
 	bool destruct_this;
+
+	// Returns the OpenGL internal format
+	static std::uint32_t InternalFormat(TextureFormat format);
+
+	// Allocate the storage and apply the sampler
+	void Create(int channels, TextureDesc const& desc);
+
+	// Upload the base level and build the mipmaps
+	void Upload(std::uint8_t const* data);
+
+	// Build every level from the base level, the data is required by the CPU mode
+	void GenerateMipmaps(std::uint8_t const* data);
 };
 
-} // !Mathyw
\ No newline at end of file
+} // !Mathyw
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "./texture.hpp"
+
+namespace Mathyw {
+
+// Handle of an image stored in a TextureAtlas
+struct AtlasImage final
+{
+	std::uint32_t id = ~0u;
+
+	// Returns true if the handle refers to an image
+	inline operator bool() const { return id != ~0u; }
+};
+
+// Location of an image inside the pages of a TextureAtlas
+struct AtlasRegion final
+{
+	int page; // index of the page texture
+	Ivec4 rect; // x, y, width and height in pixels
+	Fvec4 uv; // left, bottom, right and top texture coordinates
+};
+
+// Packing statistics of a TextureAtlas
+struct TextureAtlasStats final
+{
+	int pages = 0;
+	std::uint32_t images = 0;
+	std::size_t used_pixels = 0; // pixels covered by images, padding excluded
+	std::size_t page_pixels = 0; // pixels of every page
+	double pack_seconds = 0.0; // time spent searching placements, including repacks
+
+	// Returns the fraction of the pages covered by images
+	inline float Density() const { return page_pixels ? float(used_pixels) / page_pixels : 0.0f; }
+};
+
+// Packs many images into a few shared textures (pages) so they can be drawn without rebinding.
+// Placements are chosen with the MaxRects best-short-side-fit heuristic, new pages are added when full.
+// A CPU copy of each image is kept so the atlas can be repacked after removals.
+class TextureAtlas final
+{
+public:
+	// Initialize an empty atlas
+	// @param page_size: size of each page texture
+	// @param channels: channels of the pages and every image, expects 1 to 4
+	// @param padding: pixels around each image filled with its edge, prevents bleeding when filtered
+	// @param desc: format and sampling of the pages, mipmaps are not supported
+	TextureAtlas(Ivec2 page_size, int channels = 4, int padding = 1, TextureDesc const& desc = {});
+
+	// Insert an image, returns an empty handle if it is empty or larger than a page
+	// @param data: pixels with the channels of the atlas
+	// @param size: size of the image
+	// @param row_pitch: bytes from one row of the data to the next, tightly packed if zero
+	AtlasImage Insert(std::uint8_t const* data, Ivec2 size, std::size_t row_pitch = 0);
+
+	// Load an image file and insert it, flipped vertically as Texture(path) does
+	AtlasImage Insert(std::string const& path);
+
+	// Release an image, its space is reused by later insertions
+	void Remove(AtlasImage image);
+
+	// Returns the location of an image, it changes after Repack()
+	AtlasRegion const& Region(AtlasImage image) const;
+
+	// Returns a page texture
+	inline Texture& Page(int index) { return pages[index].texture; }
+
+	// Returns the number of pages
+	inline int PageCount() const { return (int)pages.size(); }
+
+	// Place every image again from the largest to the smallest,
+	// merges the space fragmented by removals and drops pages left empty
+	void Repack();
+
+	// Returns the packing statistics
+	TextureAtlasStats Stats() const;
+
+private:
+	// A page texture and its free rectangles, which may overlap each other
+	struct AtlasPage final
+	{
+		Texture texture;
+		std::vector<Ivec4> free_rects;
+	};
+
+	// An image and its CPU copy
+	struct Entry final
+	{
+		AtlasRegion region;
+		std::vector<std::uint8_t> pixels;
+		bool alive;
+	};
+
+	Ivec2 page_size;
+	int channels, padding;
+	TextureDesc desc;
+	std::vector<AtlasPage> pages;
+	std::vector<Entry> entries;
+	std::vector<std::uint32_t> free_ids;
+	double pack_seconds;
+
+	// Find a place for the entry in any page (adding one if needed), then upload it
+	void Place(Entry& entry);
+
+	// Upload the entry to its region, its padding filled with the edge pixels
+	void Upload(Entry const& entry);
+};
+
+} // !Mathyw
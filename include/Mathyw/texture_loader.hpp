@@ -0,0 +1,116 @@
+#pragma once
+
+#include "./texture.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+
+namespace Mathyw {
+
+// Progress of a texture requested from a TextureLoader
+enum class TextureStatus
+{
+	Decoding,	// waiting for or being decoded by a worker thread
+	Uploading,	// decoded, being uploaded on the GL thread
+	Ready,		// the texture is complete
+	Failed		// the file could not be decoded
+};
+
+// A texture loaded in the background, shared between the loader and the user
+class AsyncTexture final
+{
+public:
+	// Frees the decoded image if it is never uploaded
+	~AsyncTexture();
+
+	// Returns the progress of the texture
+	inline TextureStatus Status() const { return status.load(std::memory_order_acquire); }
+
+	// Returns true if the texture is complete
+	inline bool Ready() const { return Status() == TextureStatus::Ready; }
+
+	// Returns the texture, nullptr until it is complete
+	inline Texture* Get() { return Ready() ? texture.get() : nullptr; }
+
+	// Returns the path of the image
+	inline std::string const& Path() const { return path; }
+
+	// Returns the reason of the failure, empty if not failed
+	inline std::string const& ErrorMessage() const { return err_message; }
+
+private:
+	friend class TextureLoader;
+
+	std::string path;
+	int channels; // requested channels, zero for the channels of the file
+	bool flip;
+	TextureDesc desc;
+	std::atomic<TextureStatus> status = TextureStatus::Decoding;
+	std::uint8_t* pixels = nullptr; // decoded by stb_image
+	Ivec2 size;
+	int components = 0; // channels of the decoded pixels
+	int rows_uploaded = 0;
+	std::unique_ptr<Texture> texture;
+	std::string err_message;
+};
+
+// Handle of a texture requested from a TextureLoader
+using TextureHandle = std::shared_ptr<AsyncTexture>;
+
+// Loads textures without blocking the GL thread.
+// Images are decoded by a pool of worker threads, then uploaded through a pixel buffer object
+// in chunks of rows by Update(), which spends at most a time budget per call.
+class TextureLoader final
+{
+public:
+	// Start the decode threads
+	// @param threads: number of decode threads, uses the hardware concurrency minus one if zero
+	// @param chunk_size: bytes uploaded per pixel buffer transfer
+	TextureLoader(unsigned threads = 0, std::size_t chunk_size = 4 << 20);
+
+	// No copy construct allowed
+	TextureLoader(TextureLoader const&) = delete;
+
+	// No reassignment operator
+	TextureLoader& operator=(TextureLoader const&) = delete;
+
+	// Stop the decode threads, textures still decoding are never completed
+	~TextureLoader();
+
+	// Request a texture, returns immediately
+	// @param channels: number of channels to be loaded (1 to 4), uses default if zero
+	// @param flip: flip the image vertically, as Texture(path) does
+	// @param desc: format, mipmaps and sampling of the texture, mipmaps are built after the last chunk
+	TextureHandle Load(std::string const& path, int channels = 0, bool flip = true, TextureDesc const& desc = {});
+
+	// Upload decoded images, must be called on the GL thread (usually once per frame)
+	// @param budget: seconds to spend at most, at least one chunk is uploaded if any is available
+	void Update(double budget = 0.002);
+
+	// Block until every requested texture is complete or failed, must be called on the GL thread
+	void Finish();
+
+	// Returns the number of textures neither complete nor failed
+	inline std::size_t Pending() const { return pending.load(std::memory_order_acquire); }
+
+private:
+	std::size_t chunk_size;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable job_available, job_decoded;
+	std::deque<TextureHandle> jobs, decoded; // guarded by the mutex
+	std::deque<TextureHandle> uploading; // GL thread only
+	std::atomic<std::size_t> pending;
+	std::uint32_t pbo;
+	bool stop;
+
+	// Decode images until the loader is destroyed
+	void Work();
+
+	// Upload one chunk of the first image in the upload queue
+	void UploadChunk();
+};
+
+} // !Mathyw
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "./core.hpp"
+
+namespace Mathyw {
+
+// OpenGL uniform buffer object bound to a binding point, shared by every shader whose
+// uniform block is bound to the same point (see Shader::UniformBlock).
+// Keeps a copy of its content so uploading identical data costs no driver call.
+class UniformBufferBase
+{
+public:
+	// Initialize the buffer
+	// @param size: size of the block in bytes
+	// @param binding: the binding point of the buffer
+	UniformBufferBase(std::size_t size, std::uint32_t binding);
+
+	// No copy construct allowed (use move instead)
+	UniformBufferBase(UniformBufferBase const&) = delete;
+
+	// No reassignment operator
+	UniformBufferBase& operator=(UniformBufferBase const&) = delete;
+
+	// Move constructor (transfer ownership)
+	UniformBufferBase(UniformBufferBase&&) noexcept;
+
+	// Destructor
+	~UniformBufferBase();
+
+	// Upload data into the buffer, skipped if it is identical to the content
+	// @param offset: the number of bytes to skip at the beginning of the buffer
+	void Upload(std::span<std::byte const> data, std::size_t offset = 0);
+
+	// Bind the buffer to its binding point
+	void Bind();
+
+	// Returns the binding point
+	inline std::uint32_t Binding() const { return binding; }
+
+	// Returns the size of the block in bytes
+	inline std::size_t Size() const { return content.size(); }
+
+protected:
+	std::uint32_t bufferid, binding;
+	std::vector<std::byte> content;
+	bool destruct_this;
+};
+
+// Uniform buffer storing a single struct.
+// The struct must follow the std140 layout of the block in the shader
+// (vec3 and vec4 are 16-byte aligned, array elements are padded to 16 bytes).
+template<class Ty> requires std::is_trivially_copyable_v<Ty>
+class UniformBuffer final : public UniformBufferBase
+{
+public:
+	// Initialize the buffer with a value
+	// @param binding: the binding point of the buffer
+	UniformBuffer(std::uint32_t binding, Ty const& value = Ty())
+		: UniformBufferBase(sizeof(Ty), binding)
+	{
+		Set(value);
+	}
+
+	// Set the value, uploads only if it is changed
+	void Set(Ty const& value)
+	{
+		Upload(std::span((std::byte const*)&value, sizeof(Ty)));
+	}
+
+	// Returns the value
+	inline Ty Get() const
+	{
+		Ty value;
+		std::memcpy(&value, content.data(), sizeof(Ty));
+		return value;
+	}
+};
+
+} // !Mathyw
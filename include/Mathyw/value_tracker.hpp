@@ -44,6 +44,15 @@ public:
 	// Constructs and initialize value
 	ValueTracker(float init = 0.0f);
 
+	// Copy constructor, the copy counts as a separate active tracker
+	ValueTracker(ValueTracker const& tracker);
+
+	// Copy assignment
+	ValueTracker& operator=(ValueTracker const& tracker);
+
+	// Destructor
+	~ValueTracker();
+
 	// Add a value transform function into the tracker
 	// @param target: the target value that will be reached
 	// @param duration: time duration of the whole task (in seconds)
@@ -64,6 +73,13 @@ public:
 
 	// Get the current value
 	float Get() const;
+
+	// Returns true if the tracker still has tasks to run, or loops over them
+	inline bool Active() const { return counted; }
+
+	// Returns how many trackers are active in the process, zero means no value is animating
+	// (used by the on-demand Run loop to decide whether it could sleep)
+	static int ActiveCount();
 	
 private:
 	// All information of a single task
@@ -75,6 +91,10 @@ private:
 	};
 	float value, now, length;
 	std::vector<Task> tasklist;
+	bool looping, counted;
+
+	// Recompute whether the tracker is active and update the process wide count
+	void Track();
 };
 
 } // !Mathyw
\ No newline at end of file
@@ -16,24 +16,79 @@ enum class Primitives : std::uint8_t
 	TriangleFan
 };
 
-// Vertex array layout, calculates offsets and the stride. 
-// Increments the attribute position as it goes
+// Vertex buffer usage, decides how the buffer is allocated and updated
+enum class BufferUsage : std::uint8_t
+{
+	Static,		// uploaded once, updates go through glBufferSubData
+	Dynamic,	// updated often, full updates orphan the previous storage
+	Stream		// updated every frame, triple buffered ring guarded by fences
+};
+
+// Index buffer element type
+enum class IndexType : std::uint8_t
+{
+	Auto,	// narrowest of Uint16 and Uint32 that holds the largest index
+	Uint8,	// only chosen explicitly, many GPUs widen byte indices in the driver
+	Uint16,
+	Uint32
+};
+
+// Counters of vertex buffer uploads, reset them every frame to verify no stalls occur
+struct BufferUploadStats final
+{
+	std::uint64_t bytes = 0;	// bytes written into buffers
+	std::uint32_t updates = 0;	// number of buffer updates
+	std::uint32_t orphans = 0;	// number of buffer storages orphaned
+	std::uint32_t stalls = 0;	// number of fence waits that blocked the cpu
+};
+
+// Component type of a vertex attribute
+enum class AttribType : std::uint8_t
+{
+	Float,			// 32-bit float
+	Half,			// 16-bit float
+	Int8,			// integers, read as int/uint in shader
+	Uint8,
+	Int16,
+	Uint16,
+	Int32,
+	Uint32,
+	Int8Norm,		// normalized integers, read as float in [-1, 1] or [0, 1]
+	Uint8Norm,
+	Int16Norm,
+	Uint16Norm,
+	Int2_10_10_10,	// packed into 32 bits and normalized, count must be 4
+	Uint2_10_10_10
+};
+
+// Returns the size of the attribute in bytes
+// @param count: number of components
+int AttribSize(AttribType type, int count);
+
+// Vertex array layout, calculates offsets and the stride (in bytes).
+// Increments the attribute position as it goes.
+// Attributes are tightly packed, keep each of them 4-byte aligned for the best fetch speed.
 struct VertexLayout final
 {
-	// Initialize the layout
+	// Initialize the layout with float attributes
 	// @param args: each indicates the count of the attribute
 	template<class... Tys> requires (std::is_same_v<Tys, int> && ...)
 	VertexLayout(Tys... args) { (Add(args), ...); }
 
 	// Add a vertex attribute
-	void Add(int count);
+	// @param count: number of components, expects 1 to 4
+	// @param type: the component type of the attribute
+	void Add(int count, AttribType type = AttribType::Float);
 
 	// Vertex attributes
-	struct Attribute final { int count, offset; };
+	struct Attribute final { int count, offset; AttribType type; };
 	std::vector<Attribute> attributes;
 	int stride = 0;
 };
 
+class MeshPool;
+class DrawBatch;
+
 // OpenGL vertex array object, allows user to link multiple VBOs and IBO
 class VertexArray
 {
@@ -65,46 +120,113 @@ public:
 	// Equivalent to Bind(this)
 	void Bind();
 
+	// Link a vertex buffer object to this vao
+	// @param data: the raw vertex data, the size must equal to layout.stride times the indices count in the constructor,
+	//				or empty to leave the storage uninitialized until UpdateVBO
+	// @param layout: specify the layout for the specific buffer
+	// @param usage: how often the buffer is going to be updated
+	void LinkVBO(std::span<std::byte const> data, VertexLayout layout, BufferUsage usage = BufferUsage::Static);
+
 	// Link a vertex buffer object to this vao
 	// @param data: the array pointer that points the data,
 	//				the size of array must equal to the indices count in the constructor
 	// @param layout: specify the layout for the specific buffer
-	void LinkVBO(float const* data, VertexLayout layout);
+	// @param usage: how often the buffer is going to be updated
+	void LinkVBO(float const* data, VertexLayout layout, BufferUsage usage = BufferUsage::Static);
+
+	// Update the content of a linked vertex buffer object
+	// @param index: the index of the vbo, in the order they are linked
+	// @param data: the new raw data, offset + data.size() must not exceed the buffer size
+	// @param offset: the number of bytes to skip at the beginning of the buffer
+	void UpdateVBO(int index, std::span<std::byte const> data, std::size_t offset = 0);
 
 	// Link a index buffer object to this vao
 	// @param data: the array pointer that points to the indices data
 	// @param count: the size of that array
-	void LinkIBO(unsigned const* data, std::uint32_t count);
+	// @param type: the type stored on the GPU, every index must fit in it
+	void LinkIBO(unsigned const* data, std::uint32_t count, IndexType type = IndexType::Auto);
+
+	// Link a index buffer object with 16-bit indices to this vao
+	// @param data: the array pointer that points to the indices data
+	// @param count: the size of that array
+	// @param type: the type stored on the GPU, every index must fit in it
+	void LinkIBO(std::uint16_t const* data, std::uint32_t count, IndexType type = IndexType::Uint16);
+
+	// Link a index buffer object with 8-bit indices to this vao
+	// @param data: the array pointer that points to the indices data
+	// @param count: the size of that array
+	void LinkIBO(std::uint8_t const* data, std::uint32_t count);
 
 	// Link a vbo with a container object instead of pointers.
 	// @param container: the specific conatiner that has operator[] and size() defined
 	// @param layout: specify the layout for the specific buffer
+	// @param usage: how often the buffer is going to be updated
 	template<ContainerType Ty>
-	void LinkVBO(Ty&& container, VertexLayout layout)
+	void LinkVBO(Ty&& container, VertexLayout layout, BufferUsage usage = BufferUsage::Static)
 	{
-		MATHYW_ASSERT(container.size() == layout.stride * count_indices,
+		std::size_t bytes = container.size() * sizeof(container[0]);
+		MATHYW_ASSERT(bytes == std::size_t(layout.stride) * count_indices,
 			"Illegal size of container in LinkVBO");
-		LinkVBO(&container[0], layout);
+		LinkVBO(std::span((std::byte const*)&container[0], bytes), layout, usage);
 	}
 
-	// Link a ibo with a container object instead of pointers.
+	// Update a vbo with a container object instead of raw bytes.
+	// @param index: the index of the vbo, in the order they are linked
 	// @param container: the specific conatiner that has operator[] and size() defined
+	// @param offset: the number of container elements to skip at the beginning of the buffer
 	template<ContainerType Ty>
-	void LinkIBO(Ty&& container)
+	void UpdateVBO(int index, Ty&& container, std::size_t offset = 0)
+	{
+		std::size_t elem = sizeof(container[0]);
+		UpdateVBO(index, std::span((std::byte const*)&container[0], container.size() * elem), offset * elem);
+	}
+
+	// Link a ibo with a container object instead of pointers.
+	// @param container: the specific conatiner that has operator[] and size() defined
+	// @param args: the optional index type
+	template<ContainerType Ty, class... Tys> requires (sizeof...(Tys) <= 1 && (std::is_same_v<Tys, IndexType> && ...))
+	void LinkIBO(Ty&& container, Tys... args)
 	{
-		LinkIBO(&container[0], (std::uint32_t)container.size());
+		LinkIBO(&container[0], (std::uint32_t)container.size(), args...);
 	}
 
 	// Draw the vertex array object and pass vertex data into shader
 	void Draw();
 
+	// Returns the upload counters accumulated since the last reset
+	static BufferUploadStats const& UploadStats();
+
+	// Reset the upload counters, usually called once per frame
+	static void ResetUploadStats();
+
 private:
+	// Number of regions in the ring of a stream buffer
+	static constexpr std::uint32_t stream_regions = 3;
+
+	// A vertex buffer object linked to this vao
+	struct Buffer final
+	{
+		std::uint32_t id, attribloc, region;
+		BufferUsage usage;
+		VertexLayout layout;
+		std::array<void*, stream_regions> fences; // GLsync of each region (stream only)
+		std::vector<std::byte> shadow; // cpu copy for partial updates (stream only)
+	};
+
 	std::uint32_t vaoid, iboid;
-	std::vector<std::uint32_t> vboids;
-	std::uint32_t attribloc;
+	std::vector<Buffer> vbos;
+	std::uint32_t attribloc, index_type;
 	int count_indices, elem_to_draw;
 	Primitives primitives;
 	bool destruct_this;
+
+	// Upload the indices as they are
+	// @param type: OpenGL enum of the index type
+	void LinkIndices(void const* data, std::uint32_t count, std::uint32_t type);
+
+	// Friend classes
+	friend class MeshPool;
+	friend class DrawBatch;
 };
 
 } // !Mathyw
\ No newline at end of file
@@ -1,8 +1,10 @@
 #pragma once
 
 #include "./monitor.hpp"
-#include "./event.hpp"
+#include "./event_queue.hpp"
+#include "./input_state.hpp"
 #include "./color.hpp"
+#include "./clock.hpp"
 
 namespace Mathyw {
 
@@ -17,6 +19,8 @@ enum : std::uint8_t
 	WindowAutoIconify	= 1 << 4, // enable auto iconify
 	WindowAlwaysOnTop	= 1 << 5, // enable always on top
 	WindowMaximized		= 1 << 6, // maximize the window
+	WindowHeadless		= 1 << 7, // offscreen rendering only: hidden, no vsync and no buffer swaps,
+								  // falls back to EGL or OSMesa contexts if the native one is unavailable
 
 	WindowDefault = WindowResizable	// default settings (0001 1111)
 				  | WindowVisible
@@ -40,6 +44,22 @@ enum class WindowCursor : std::uint32_t {
 	VResize		= 0x36006,
 };
 
+// Swap interval of a window
+enum class VsyncMode
+{
+	Off,		// swap immediately, could tear
+	On,			// wait for the vertical blank
+	Adaptive	// wait for the vertical blank unless the frame is late, then tear instead of stalling a whole refresh,
+				// falls back to On without the swap_control_tear extension
+};
+
+// Latency measurements of a window, from polling the input of a frame (in seconds)
+struct LatencyStats final
+{
+	FrameStats present;		// to the buffer swap returning
+	FrameStats complete;	// to the gpu finishing the frame, observed by the fences of FramesInFlight or LowLatency
+};
+
 // Contains window data
 struct WindowData final
 {
@@ -49,8 +69,14 @@ struct WindowData final
 	std::function<void(Event const&)> callback;
 	Ivec4 viewport;
 	WindowCursorMode cursor_mode;
+	bool headless;
+	bool redraw; // a frame was requested by RequestRedraw
+	EventQueue* queue; // where the events go instead of the callback, nullptr if events are not queued
+	InputSnapshot input; // updated by the callbacks, published once per frame by PublishInput
 };
 
+struct RunConfig;
+
 // Manage and control window
 class Window final
 {
@@ -78,19 +104,36 @@ public:
 	// Move constructor (transfer ownership)
 	Window(Window&&) noexcept;
 
-	// Specify which window to use
+	// Specify which window to use on the calling thread, its context becomes current there.
+	// A context is current on one thread at a time, unbind it before binding it on another thread
 	// @param window: could be nullptr if no window are used
 	static void Bind(Window* window);
 
-	// Returns the current window binded
+	// Returns the window binded on the calling thread
 	static Window* Current();
 
 	// Equivalent to Bind(this)
 	void Bind();
 
-	// Poll window events and swap buffers
+	// Poll window events and swap buffers (headless windows only poll events)
 	void Update();
 
+	// Swap buffers without polling events (headless windows do nothing)
+	void Present();
+
+	// Process the pending events of every window
+	static void PollEvents();
+
+	// Sleep until an event arrives, then process it
+	// @param timeout: the longest time to sleep (in seconds), zero to sleep without limit
+	static void WaitEvents(double timeout = 0.0);
+
+	// Wake a thread sleeping in WaitEvents, could be called from any thread
+	static void Wake();
+
+	// Ask the on-demand Run loop to draw a frame even if nothing is animating
+	void RequestRedraw();
+
 	// Close the window (would not call WindowClosedEvent)
 	void Close();
 
@@ -103,7 +146,9 @@ public:
 	inline std::string_view Title() const { return data.title; }
 	inline Ivec4 Viewport() const { return data.viewport; }
 	inline bool Vsync() const { return data.has_vsync; }
+	inline VsyncMode CurrentVsync() const { return vsync_mode; }
 	inline WindowCursorMode CursorMode() const { return data.cursor_mode; }
+	inline bool Headless() const { return data.headless; }
 
 	// Returns false if window is closed, or Close() is called
 	inline bool Active() const { return data.active; }
@@ -114,8 +159,32 @@ public:
 	void Title(std::string const& title);
 	void Viewport(Ivec4 viewport);
 	void Vsync(bool enable);
+	void Vsync(VsyncMode mode);
 	void CursorMode(WindowCursorMode mode);
 
+	// Limit how many frames the driver could queue, Present waits for the gpu to finish older frames.
+	// Fewer frames in flight mean less latency between the input and the picture, but less cpu and gpu overlap.
+	// @param count: zero to leave the queue to the driver
+	void FramesInFlight(int count);
+
+	// Returns the limit of frames in flight, zero if the driver decides
+	inline int FramesInFlight() const { return (int)fences.size(); }
+
+	// Low latency mode: Present waits for the gpu to finish the frame before swapping,
+	// and the Run loop delays polling the input of the next frame until just enough time is left
+	// to draw it before the next vertical blank, estimated from the previous frames.
+	// Only effective with vsync.
+	void LowLatency(bool enable);
+
+	// Returns true if the low latency mode is enabled
+	inline bool LowLatency() const { return low_latency; }
+
+	// Returns the latency measurements since the last reset
+	inline LatencyStats const& Latency() const { return latency; }
+
+	// Reset the latency measurements
+	void ResetLatency();
+
 	// Set window event callback
 	void EventCallback(std::function<void(Window&, Event const&)> const& callback);
 
@@ -129,23 +198,90 @@ public:
 		});
 	}
 
+	// Store the events in a queue instead of calling the event callback right away,
+	// they are handled in a batch by Dispatch (usually once per frame)
+	// @param capacity: events held between two dispatches, further events are dropped except WindowClosedEvent
+	// @param custom_capacity: custom events posted between two dispatches
+	void QueueEvents(std::size_t capacity = 256, std::size_t custom_capacity = 256);
+
+	// Returns the event queue, nullptr if events are not queued
+	inline EventQueue* Queue() { return event_queue.get(); }
+
+	// Post a custom event and wake the thread waiting for events, could be called from any thread
+	// once QueueEvents is called. Returns false if the queue is full or events are not queued
+	bool Post(CustomEvent const& event);
+
+	// Call the handler with every queued event, the handler is usually an EventHandlers.
+	// Closes the window on a WindowClosedEvent if the handler does not take it
+	template<class Handler>
+	void Dispatch(Handler&& handler)
+	{
+		if (!event_queue) return;
+		event_queue->Dispatch([&](auto const& event) {
+			using Ty = std::decay_t<decltype(event)>;
+			if constexpr (std::is_invocable_v<Handler&, Ty const&>) handler(event);
+			else if constexpr (std::is_same_v<Ty, WindowClosedEvent>) Close();
+		});
+	}
+
+	// Swap buffers, poll events and dispatch them to the handler
+	template<class Handler>
+	void Update(Handler&& handler)
+	{
+		Update();
+		Dispatch(handler);
+	}
+
 	// Change cursor look
 	void CursorLook(WindowCursor cursor);
 
-	// Returns true if specific key is being pressed
+	// Returns the input state of the last published frame, could be called from any thread
+	inline InputSnapshot Input() const { return input_state->Read(); }
+
+	// Publish the input state gathered by the callbacks and start the changes of the next frame,
+	// called by Update and Run after polling the events
+	void PublishInput();
+
+	// Returns true if specific key is being pressed (main thread only, see Input())
 	bool IsKeyPressed(KeyCode keycode) const;
 
-	// Returns true if specific mouse button is being pressed
+	// Returns true if specific mouse button is being pressed (main thread only, see Input())
 	bool IsMouseButtonPressed(MouseButton button) const;
 
 	// Get the current mouse position, where the origin is on the top-left corner
-	// and downard is the positive direction of y
+	// and downard is the positive direction of y (main thread only, see Input())
 	Ivec2 MousePosition() const;
 
 private:
+	// A fence after the commands of a frame and when the input of the frame was polled
+	struct FrameFence final { void* fence; std::int64_t input; };
+
 	void* window;
 	WindowData data;
+	std::unique_ptr<EventQueue> event_queue;
+	std::unique_ptr<InputState> input_state;
+	VsyncMode vsync_mode;
+	std::vector<FrameFence> fences; // ring of the frames in flight
+	std::size_t fence_index;
+	bool low_latency;
+	std::int64_t last_swap, work_estimate; // nanoseconds, for the low latency mode
+	LatencyStats latency;
 	bool destruct_this;
+
+	// Wait for the fence of a frame and record its latency
+	// @param timeout: nanoseconds, zero to only check if the frame is finished
+	// Returns false if the frame is not finished yet
+	bool FinishFrame(FrameFence& frame, std::uint64_t timeout);
+
+	// Delete every fence in flight after waiting for them
+	void FinishFrames();
+
+	// Returns when the input of the next frame should be polled in low latency mode, zero if it should be polled now
+	std::int64_t InputDeadline() const;
+
+	// Friend functions
+	friend void Run(Window& window, RunConfig const& config,
+		std::function<void(double)> const& update, std::function<void(double)> const& render);
 };
 
 // OpenGL capabilities
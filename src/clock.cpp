@@ -1,26 +1,130 @@
 #include <Mathyw/clock.hpp>
-#include <Mathyw/opengl.hpp>
-#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
 
 namespace Mathyw {
 
 Clock::Clock()
+	: timepoint(Now())
 {
-	InitGL();
-	timepoint = static_cast<float>(glfwGetTime());
 }
 
-float Clock::Elapsed() const
+std::int64_t Clock::Now()
 {
-	auto now = static_cast<float>(glfwGetTime());
-	return now - timepoint;
+	using namespace std::chrono;
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
 }
 
-float Clock::Restart()
+double Clock::Elapsed() const
 {
-	float x = Elapsed();
-	timepoint = static_cast<float>(glfwGetTime());
-	return x;
+	return ElapsedNanoseconds() * 1e-9;
 }
 
-}
\ No newline at end of file
+std::int64_t Clock::ElapsedNanoseconds() const
+{
+	return Now() - timepoint;
+}
+
+double Clock::Restart()
+{
+	return RestartNanoseconds() * 1e-9;
+}
+
+std::int64_t Clock::RestartNanoseconds()
+{
+	auto now = Now();
+	auto elapsed = now - timepoint;
+	timepoint = now;
+	return elapsed;
+}
+
+FrameStats::FrameStats()
+{
+	Reset();
+}
+
+int FrameStats::BucketIndex(std::uint64_t nanoseconds)
+{
+	// values below sub_buckets are exact, every power of two above is split into sub_buckets linear steps
+	if (nanoseconds < (std::uint64_t)sub_buckets) return (int)nanoseconds;
+	int shift = std::bit_width(nanoseconds) - 1 - sub_bits;
+	return (shift + 1) * sub_buckets + (int)((nanoseconds >> shift) - sub_buckets);
+}
+
+std::uint64_t FrameStats::BucketLower(int index)
+{
+	if (index < sub_buckets) return (std::uint64_t)index;
+	int shift = index / sub_buckets - 1;
+	return std::uint64_t(index % sub_buckets + sub_buckets) << shift;
+}
+
+void FrameStats::Add(std::int64_t nanoseconds)
+{
+	nanoseconds = std::max<std::int64_t>(nanoseconds, 0);
+	buckets[BucketIndex((std::uint64_t)nanoseconds)]++;
+	min = count ? std::min(min, nanoseconds) : nanoseconds;
+	max = count ? std::max(max, nanoseconds) : nanoseconds;
+	count++;
+	double delta = nanoseconds - mean;
+	mean += delta / count;
+	m2 += delta * (nanoseconds - mean);
+}
+
+void FrameStats::Reset()
+{
+	buckets.fill(0);
+	count = 0;
+	min = max = 0;
+	mean = m2 = 0.0;
+}
+
+double FrameStats::Min() const
+{
+	return min * 1e-9;
+}
+
+double FrameStats::Max() const
+{
+	return max * 1e-9;
+}
+
+double FrameStats::Mean() const
+{
+	return mean * 1e-9;
+}
+
+double FrameStats::StdDev() const
+{
+	return count ? std::sqrt(m2 / count) * 1e-9 : 0.0;
+}
+
+double FrameStats::Percentile(double p) const
+{
+	if (!count) return 0.0;
+	auto rank = (std::uint64_t)std::ceil(std::clamp(p, 0.0, 1.0) * count);
+	rank = std::max<std::uint64_t>(rank, 1);
+	std::uint64_t seen = 0;
+	for (int i = 0; i < bucket_count; i++)
+	{
+		seen += buckets[i];
+		if (seen < rank) continue;
+		// the middle of the bucket, the exact extremes are known
+		double lower = (double)BucketLower(i), upper = (double)BucketLower(i + 1);
+		double value = std::clamp((lower + upper) / 2.0, (double)min, (double)max);
+		return value * 1e-9;
+	}
+	return max * 1e-9;
+}
+
+std::vector<FrameStats::Bucket> FrameStats::Histogram() const
+{
+	std::vector<Bucket> histogram;
+	for (int i = 0; i < bucket_count; i++)
+		if (buckets[i])
+			histogram.push_back(Bucket{ BucketLower(i) * 1e-9, BucketLower(i + 1) * 1e-9, buckets[i] });
+	return histogram;
+}
+
+} // !Mathyw
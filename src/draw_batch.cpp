@@ -0,0 +1,141 @@
+#include <Mathyw/draw_batch.hpp>
+#include <Mathyw/opengl.hpp>
+#include <Mathyw/state_cache.hpp>
+#include <algorithm>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+namespace Mathyw {
+
+// OpenGL 4.3 enums and functions, not provided by the 3.3 loader
+static constexpr GLenum gl_draw_indirect_buffer = 0x8F3F;
+static constexpr GLenum gl_shader_storage_buffer = 0x90D2;
+using MultiDrawElementsIndirectProc = void (APIENTRYP)(GLenum, GLenum, void const*, GLsizei, GLsizei);
+
+static bool force_fallback = false;
+
+DrawBatch::DrawBatch(MeshPool& pool, std::uint32_t data_size, std::uint32_t binding)
+	: pool(&pool), data_size(data_size), binding(binding), id_capacity(0), destruct_this(true)
+{
+	glGenBuffers(1, &command_buffer);
+	glGenBuffers(1, &data_buffer);
+	glGenBuffers(1, &id_buffer);
+}
+
+DrawBatch::DrawBatch(DrawBatch&& batch) noexcept
+	: pool(batch.pool), data_size(batch.data_size), binding(batch.binding),
+	command_buffer(batch.command_buffer), data_buffer(batch.data_buffer), id_buffer(batch.id_buffer),
+	id_capacity(batch.id_capacity), commands(std::move(batch.commands)), data(std::move(batch.data)), destruct_this(true)
+{
+	batch.destruct_this = false;
+}
+
+DrawBatch::~DrawBatch()
+{
+	if (!destruct_this) return;
+	auto& state = GLStateCache::Current();
+	for (auto buffer : { command_buffer, data_buffer, id_buffer })
+	{
+		glDeleteBuffers(1, &buffer);
+		state.BufferDeleted(buffer);
+	}
+}
+
+void DrawBatch::Clear()
+{
+	commands.clear();
+	data.clear();
+}
+
+void DrawBatch::Add(Mesh mesh, std::span<std::byte const> data)
+{
+	MATHYW_ASSERT(data.size() == data_size, "DrawBatch::Add data size must equal to data_size");
+	MeshRange range = pool->Range(mesh);
+	MATHYW_ASSERT(range.index_count, "DrawBatch only accepts indexed meshes");
+	auto index = (std::uint32_t)commands.size();
+	commands.emplace_back(range.index_count, 1u, range.index_offset, (std::int32_t)range.vertex_offset, index);
+	this->data.insert(this->data.end(), data.begin(), data.end());
+}
+
+bool DrawBatch::IndirectSupported()
+{
+	if (force_fallback) return false;
+	static bool supported = GLSupports(4, 3)
+		|| (GLSupports("GL_ARB_multi_draw_indirect")
+			&& GLSupports("GL_ARB_base_instance")
+			&& GLSupports("GL_ARB_shader_storage_buffer_object"));
+	return supported;
+}
+
+void DrawBatch::ForceFallback(bool enable)
+{
+	force_fallback = enable;
+}
+
+void DrawBatch::Submit()
+{
+	if (commands.empty()) return;
+	auto& vao = pool->vao;
+	auto count = (std::uint32_t)commands.size();
+	std::uint32_t location = vao.attribloc;
+	auto& state = GLStateCache::Current();
+	vao.Bind();
+
+	if (IndirectSupported())
+	{
+		// draw ids 0, 1, 2... read once per instance, baseInstance of each command selects its own
+		if (id_capacity < count)
+		{
+			id_capacity = std::max(count, id_capacity * 2);
+			std::vector<std::uint32_t> ids(id_capacity);
+			for (auto i = 0u; i < id_capacity; i++) ids[i] = i;
+			state.BindBuffer(GL_ARRAY_BUFFER, id_buffer);
+			glBufferData(GL_ARRAY_BUFFER, id_capacity * sizeof(std::uint32_t), ids.data(), GL_STATIC_DRAW);
+		}
+		else state.BindBuffer(GL_ARRAY_BUFFER, id_buffer);
+		glEnableVertexAttribArray(location);
+		glVertexAttribIPointer(location, 1, GL_UNSIGNED_INT, 0, nullptr);
+		glVertexAttribDivisor(location, 1);
+
+		// orphan and refill the command and data buffers every submission
+		state.BindBuffer(gl_draw_indirect_buffer, command_buffer);
+		glBufferData(gl_draw_indirect_buffer, count * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STREAM_DRAW);
+		if (data_size)
+		{
+			state.BindBuffer(gl_shader_storage_buffer, data_buffer);
+			glBufferData(gl_shader_storage_buffer, data.size(), data.data(), GL_STREAM_DRAW);
+			state.BindBufferBase(gl_shader_storage_buffer, binding, data_buffer);
+		}
+
+		static auto multi_draw = (MultiDrawElementsIndirectProc)GLProcAddress("glMultiDrawElementsIndirect");
+		multi_draw((unsigned)vao.primitives, vao.index_type, nullptr, (GLsizei)count, 0);
+		return;
+	}
+
+	// fallback: the draw id becomes a constant attribute, the data of each draw a range of one uniform buffer
+	glDisableVertexAttribArray(location);
+	std::size_t stride = 0;
+	if (data_size)
+	{
+		int alignment;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		stride = (data_size + alignment - 1) / alignment * alignment;
+		std::vector<std::byte> aligned(stride * count);
+		for (auto i = 0u; i < count; i++)
+			std::copy_n(data.begin() + std::size_t(i) * data_size, data_size, aligned.begin() + i * stride);
+		state.BindBuffer(GL_UNIFORM_BUFFER, data_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, aligned.size(), aligned.data(), GL_STREAM_DRAW);
+	}
+
+	std::size_t index_size = vao.index_type == GL_UNSIGNED_INT ? 4 : 2;
+	for (auto i = 0u; i < count; i++)
+	{
+		auto const& cmd = commands[i];
+		glVertexAttribI1ui(location, i);
+		if (data_size) state.BindBufferRange(GL_UNIFORM_BUFFER, binding, data_buffer, i * stride, data_size);
+		glDrawElementsBaseVertex((unsigned)vao.primitives, cmd.count, vao.index_type,
+			(void*)(cmd.first_index * index_size), cmd.base_vertex);
+	}
+}
+
+} // !Mathyw
@@ -0,0 +1,40 @@
+#include <Mathyw/event_queue.hpp>
+
+namespace Mathyw {
+
+EventQueue::EventQueue(std::size_t capacity, std::size_t custom_capacity)
+	: ring(std::max<std::size_t>(capacity, 1), WindowClosedEvent()), head(0), count(0), close_pending(false),
+	coalesced(0), dropped(0), custom(custom_capacity)
+{
+}
+
+void EventQueue::Push(QueuedEvent const& event)
+{
+	// only adjacent events merge, so a move never jumps over a click
+	if (count)
+	{
+		auto& last = ring[(head + count - 1) % ring.size()];
+		if (auto moved = std::get_if<MouseMovedEvent>(&event); moved && std::holds_alternative<MouseMovedEvent>(last))
+		{
+			std::get<MouseMovedEvent>(last).position = moved->position;
+			coalesced++;
+			return;
+		}
+		if (auto scrolled = std::get_if<MouseScrolledEvent>(&event); scrolled && std::holds_alternative<MouseScrolledEvent>(last))
+		{
+			std::get<MouseScrolledEvent>(last).offset += scrolled->offset;
+			coalesced++;
+			return;
+		}
+	}
+	if (count == ring.size())
+	{
+		// a close request is never lost, it is dispatched after the full ring
+		if (std::holds_alternative<WindowClosedEvent>(event)) close_pending = true;
+		else dropped++;
+		return;
+	}
+	ring[(head + count++) % ring.size()] = event;
+}
+
+} // !Mathyw
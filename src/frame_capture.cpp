@@ -0,0 +1,214 @@
+#include <Mathyw/frame_capture.hpp>
+#include <Mathyw/state_cache.hpp>
+#include <Mathyw/image_writer.hpp>
+#include <algorithm>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+namespace Mathyw {
+
+FrameSink RawFrameSink(std::FILE* file)
+{
+	return FrameSink{ [file](CapturedFrame const& frame) {
+		return std::fwrite(frame.pixels.data(), 1, frame.pixels.size(), file) == frame.pixels.size();
+	}, true };
+}
+
+FrameSink Y4MFrameSink(std::FILE* file, int fps)
+{
+	return FrameSink{ [file, fps, planes = std::vector<std::uint8_t>()](CapturedFrame const& frame) mutable {
+		int w = frame.size[0], h = frame.size[1], cw = (w + 1) / 2, ch = (h + 1) / 2;
+		if (frame.index == 0)
+			std::fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", w, h, fps);
+		planes.resize(std::size_t(w) * h + std::size_t(cw) * ch * 2);
+		std::uint8_t* y_plane = planes.data();
+		std::uint8_t* u_plane = y_plane + std::size_t(w) * h;
+		std::uint8_t* v_plane = u_plane + std::size_t(cw) * ch;
+
+		auto pixel = [&](int x, int y) { return frame.pixels.data() + (std::size_t(y) * w + x) * frame.channels; };
+		for (int y = 0; y < h; y++)
+			for (int x = 0; x < w; x++)
+			{
+				auto p = pixel(x, y);
+				y_plane[std::size_t(y) * w + x] = std::uint8_t(std::clamp(0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2] + 0.5f, 0.0f, 255.0f));
+			}
+		// chroma is averaged over each 2x2 block
+		for (int y = 0; y < ch; y++)
+			for (int x = 0; x < cw; x++)
+			{
+				float r = 0, g = 0, b = 0;
+				for (int i = 0; i < 4; i++)
+				{
+					auto p = pixel(std::min(x * 2 + (i & 1), w - 1), std::min(y * 2 + (i >> 1), h - 1));
+					r += p[0], g += p[1], b += p[2];
+				}
+				r *= 0.25f, g *= 0.25f, b *= 0.25f;
+				u_plane[std::size_t(y) * cw + x] = std::uint8_t(std::clamp(128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b + 0.5f, 0.0f, 255.0f));
+				v_plane[std::size_t(y) * cw + x] = std::uint8_t(std::clamp(128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b + 0.5f, 0.0f, 255.0f));
+			}
+		std::fputs("FRAME\n", file);
+		return std::fwrite(planes.data(), 1, planes.size(), file) == planes.size();
+	}, true };
+}
+
+FrameSink ImageSequenceSink(std::string const& pattern)
+{
+	return FrameSink{ [pattern](CapturedFrame const& frame) {
+		// measure the path first, a conversion could be wider than any fixed buffer
+		int length = std::snprintf(nullptr, 0, pattern.c_str(), int(frame.index));
+		if (length < 0) return false;
+		std::string path(length, '\0');
+		std::snprintf(path.data(), path.size() + 1, pattern.c_str(), int(frame.index));
+		// one thread per frame, the workers already encode frames in parallel
+		return WriteImage(path, ImageView(frame.pixels.data(), frame.size, frame.channels), 1);
+	}, false };
+}
+
+FrameCapture::FrameCapture(Ivec2 size, FrameSink sink, int channels, std::size_t queue_size, unsigned threads)
+	: size(size), channels(channels), sink(std::move(sink)), queue_size(std::max<std::size_t>(queue_size, 1)),
+	head(0), in_flight(0), captured(0), readback_stalls(0), queue_stalls(0), busy(0), written(0), failed(0), stop(false)
+{
+	MATHYW_ASSERT(channels == 3 || channels == 4, "FrameCapture expects 3 or 4 channels");
+	auto& state = GLStateCache::Current();
+	glGenBuffers(ring_size, pbos.data());
+	for (auto pbo : pbos)
+	{
+		state.BindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+		glBufferData(GL_PIXEL_PACK_BUFFER, std::size_t(size[0]) * size[1] * channels, nullptr, GL_STREAM_READ);
+	}
+	state.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	fences.fill(nullptr);
+
+	if (this->sink.ordered) threads = 1;
+	else if (!threads) threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	for (unsigned i = 0; i < threads; i++)
+		workers.emplace_back(&FrameCapture::Work, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+	Finish();
+	{
+		std::lock_guard lock(mutex);
+		stop = true;
+	}
+	queue_changed.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+	glDeleteBuffers(ring_size, pbos.data());
+	auto& state = GLStateCache::Current();
+	for (auto pbo : pbos)
+		state.BufferDeleted(pbo);
+}
+
+void FrameCapture::Capture(Framebuffer* framebuffer)
+{
+	if (in_flight == ring_size) Collect();
+	auto& state = GLStateCache::Current();
+	if (framebuffer) framebuffer->Resolve();
+	state.BindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer ? framebuffer->resolve_fbo : 0);
+
+	int slot = (head + in_flight) % ring_size;
+	state.BindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, size[0], size[1], channels == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+	fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	indices[slot] = captured++;
+	in_flight++;
+	// reads into client memory elsewhere must not go into the pixel buffer
+	state.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	Framebuffer* current = Framebuffer::Current();
+	state.BindFramebuffer(GL_READ_FRAMEBUFFER, current ? current->fbo : 0);
+
+	// collect the readbacks the GPU has already finished, so frames reach the workers early
+	while (in_flight && glClientWaitSync((GLsync)fences[head], 0, 0) != GL_TIMEOUT_EXPIRED)
+		Collect();
+}
+
+void FrameCapture::Collect()
+{
+	auto& fence = fences[head];
+	GLsync sync = (GLsync)fence;
+	if (glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+	{
+		readback_stalls++;
+		while (glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(sync);
+	fence = nullptr;
+
+	CapturedFrame frame{ indices[head], size, channels, {} };
+	{
+		std::lock_guard lock(mutex);
+		if (!spare.empty())
+		{
+			frame.pixels = std::move(spare.back());
+			spare.pop_back();
+		}
+	}
+	std::size_t row_size = std::size_t(size[0]) * channels;
+	frame.pixels.resize(row_size * size[1]);
+
+	// OpenGL stores rows from bottom to top, flip them while copying
+	auto& state = GLStateCache::Current();
+	state.BindBuffer(GL_PIXEL_PACK_BUFFER, pbos[head]);
+	auto const* src = (std::uint8_t const*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, row_size * size[1], GL_MAP_READ_BIT);
+	for (int y = 0; y < size[1]; y++)
+		std::memcpy(frame.pixels.data() + row_size * (size[1] - 1 - y), src + row_size * y, row_size);
+	glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	state.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	head = (head + 1) % ring_size;
+	in_flight--;
+
+	// backpressure: wait for a free slot instead of growing the queue
+	std::unique_lock lock(mutex);
+	if (queue.size() >= queue_size)
+	{
+		queue_stalls++;
+		queue_changed.wait(lock, [this] { return queue.size() < queue_size; });
+	}
+	queue.push_back(std::move(frame));
+	lock.unlock();
+	queue_changed.notify_all();
+}
+
+void FrameCapture::Work()
+{
+	while (true)
+	{
+		CapturedFrame frame;
+		{
+			std::unique_lock lock(mutex);
+			queue_changed.wait(lock, [this] { return stop || !queue.empty(); });
+			if (queue.empty()) return;
+			frame = std::move(queue.front());
+			queue.pop_front();
+			busy++;
+		}
+		queue_changed.notify_all();
+
+		if (!sink.write(frame)) failed.fetch_add(1, std::memory_order_relaxed);
+		written.fetch_add(1, std::memory_order_relaxed);
+		{
+			std::lock_guard lock(mutex);
+			spare.push_back(std::move(frame.pixels));
+			busy--;
+		}
+		queue_changed.notify_all();
+	}
+}
+
+void FrameCapture::Finish()
+{
+	while (in_flight) Collect();
+	std::unique_lock lock(mutex);
+	queue_changed.wait(lock, [this] { return queue.empty() && !busy; });
+}
+
+CaptureStats FrameCapture::Stats() const
+{
+	return CaptureStats{ captured, written.load(std::memory_order_relaxed), failed.load(std::memory_order_relaxed),
+		readback_stalls, queue_stalls };
+}
+
+} // !Mathyw
@@ -0,0 +1,118 @@
+#include <Mathyw/framebuffer.hpp>
+#include <Mathyw/state_cache.hpp>
+#include <Mathyw/window.hpp>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+namespace Mathyw {
+
+static constexpr int format_channels(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::R8: case TextureFormat::R16F: return 1;
+	case TextureFormat::RG8: return 2;
+	case TextureFormat::RGB8: case TextureFormat::SRGB8: return 3;
+	default: return 4;
+	}
+}
+
+static Framebuffer* binded_framebuffer = nullptr;
+
+Framebuffer::Framebuffer(Ivec2 size, FramebufferDesc const& desc)
+	: color(nullptr, size, format_channels(desc.color), TextureDesc{ desc.color, MipmapMode::None, desc.sampler }),
+	size(size), samples(desc.samples), color_rb(0), depth_rb(0), destruct_this(true)
+{
+	auto& state = GLStateCache::Current();
+	glGenFramebuffers(1, &fbo);
+	state.BindFramebuffer(GL_FRAMEBUFFER, fbo);
+	if (samples)
+	{
+		glGenRenderbuffers(1, &color_rb);
+		glBindRenderbuffer(GL_RENDERBUFFER, color_rb);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, Texture::InternalFormat(color.Format()), size[0], size[1]);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_rb);
+	}
+	else glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color.textureid, 0);
+
+	if (desc.depth)
+	{
+		glGenRenderbuffers(1, &depth_rb);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth_rb);
+		if (samples) glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, size[0], size[1]);
+		else glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size[0], size[1]);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth_rb);
+	}
+	MATHYW_ASSERT(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Framebuffer is incomplete");
+
+	resolve_fbo = fbo;
+	if (samples)
+	{
+		glGenFramebuffers(1, &resolve_fbo);
+		state.BindFramebuffer(GL_FRAMEBUFFER, resolve_fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color.textureid, 0);
+		MATHYW_ASSERT(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Framebuffer is incomplete");
+	}
+	state.BindFramebuffer(GL_FRAMEBUFFER, binded_framebuffer ? binded_framebuffer->fbo : 0);
+}
+
+Framebuffer::Framebuffer(Framebuffer&& framebuffer) noexcept
+	: color(std::move(framebuffer.color)), size(framebuffer.size), samples(framebuffer.samples),
+	fbo(framebuffer.fbo), resolve_fbo(framebuffer.resolve_fbo), color_rb(framebuffer.color_rb), depth_rb(framebuffer.depth_rb), destruct_this(true)
+{
+	framebuffer.destruct_this = false;
+	if (binded_framebuffer == &framebuffer) binded_framebuffer = this;
+}
+
+Framebuffer::~Framebuffer()
+{
+	if (!destruct_this) return;
+	if (binded_framebuffer == this) Bind(nullptr);
+	auto& state = GLStateCache::Current();
+	for (auto framebuffer : { fbo, resolve_fbo })
+	{
+		glDeleteFramebuffers(1, &framebuffer);
+		state.FramebufferDeleted(framebuffer);
+		if (resolve_fbo == fbo) break;
+	}
+	for (auto renderbuffer : { color_rb, depth_rb })
+		if (renderbuffer) glDeleteRenderbuffers(1, &renderbuffer);
+}
+
+void Framebuffer::Bind(Framebuffer* framebuffer)
+{
+	binded_framebuffer = framebuffer;
+	auto& state = GLStateCache::Current();
+	state.BindFramebuffer(GL_FRAMEBUFFER, framebuffer ? framebuffer->fbo : 0);
+	if (framebuffer) state.Viewport(Ivec4(0, 0, framebuffer->size[0], framebuffer->size[1]));
+	else if (Window::Current()) state.Viewport(Window::Current()->Viewport());
+}
+
+Framebuffer* Framebuffer::Current()
+{
+	return binded_framebuffer;
+}
+
+void Framebuffer::Bind()
+{
+	Bind(this);
+}
+
+void Framebuffer::Clear(Fvec4 color)
+{
+	Bind(this);
+	glClearColor(color[0], color[1], color[2], color[3]);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+}
+
+void Framebuffer::Resolve()
+{
+	if (!samples) return;
+	auto& state = GLStateCache::Current();
+	state.BindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+	state.BindFramebuffer(GL_DRAW_FRAMEBUFFER, resolve_fbo);
+	glBlitFramebuffer(0, 0, size[0], size[1], 0, 0, size[0], size[1], GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	state.BindFramebuffer(GL_FRAMEBUFFER, binded_framebuffer ? binded_framebuffer->fbo : 0);
+}
+
+} // !Mathyw
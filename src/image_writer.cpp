@@ -0,0 +1,398 @@
+#include <Mathyw/image_writer.hpp>
+#include <Mathyw/state_cache.hpp>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+namespace Mathyw {
+
+static void put_u32_be(std::vector<std::uint8_t>& out, std::uint32_t value)
+{
+	for (int shift = 24; shift >= 0; shift -= 8)
+		out.push_back(std::uint8_t(value >> shift));
+}
+
+std::vector<std::uint8_t> EncodeQOI(ImageView image)
+{
+	MATHYW_ASSERT(image.channels == 3 || image.channels == 4, "QOI expects 3 or 4 channels");
+	struct Rgba final { std::uint8_t r, g, b, a; bool operator==(Rgba const&) const = default; };
+	std::vector<std::uint8_t> out;
+	out.reserve(std::size_t(image.size[0]) * image.size[1] * (image.channels + 1) / 2 + 22);
+	out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+	put_u32_be(out, image.size[0]);
+	put_u32_be(out, image.size[1]);
+	out.push_back(std::uint8_t(image.channels));
+	out.push_back(0); // sRGB with linear alpha
+
+	std::array<Rgba, 64> index{};
+	Rgba prev{ 0, 0, 0, 255 };
+	int run = 0;
+	std::size_t total = std::size_t(image.size[0]) * image.size[1], count = 0;
+	for (int y = 0; y < image.size[1]; y++)
+	{
+		std::uint8_t const* row = image.pixels + y * image.row_pitch;
+		for (int x = 0; x < image.size[0]; x++)
+		{
+			std::uint8_t const* p = row + x * image.channels;
+			Rgba px{ p[0], p[1], p[2], image.channels == 4 ? p[3] : std::uint8_t(255) };
+			count++;
+			if (px == prev)
+			{
+				if (++run == 62 || count == total)
+				{
+					out.push_back(std::uint8_t(0xC0 | (run - 1)));
+					run = 0;
+				}
+				continue;
+			}
+			if (run)
+			{
+				out.push_back(std::uint8_t(0xC0 | (run - 1)));
+				run = 0;
+			}
+
+			int slot = (px.r * 3 + px.g * 5 + px.b * 7 + px.a * 11) % 64;
+			if (index[slot] == px) out.push_back(std::uint8_t(slot));
+			else
+			{
+				index[slot] = px;
+				if (px.a == prev.a)
+				{
+					int dr = std::int8_t(px.r - prev.r), dg = std::int8_t(px.g - prev.g), db = std::int8_t(px.b - prev.b);
+					int dr_dg = dr - dg, db_dg = db - dg;
+					if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+						out.push_back(std::uint8_t(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+					else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+						out.insert(out.end(), { std::uint8_t(0x80 | (dg + 32)), std::uint8_t((dr_dg + 8) << 4 | (db_dg + 8)) });
+					else out.insert(out.end(), { 0xFE, px.r, px.g, px.b });
+				}
+				else out.insert(out.end(), { 0xFF, px.r, px.g, px.b, px.a });
+			}
+			prev = px;
+		}
+	}
+	out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+	return out;
+}
+
+// Writes bits from the least significant bit first, as deflate expects
+struct BitWriter final
+{
+	std::vector<std::uint8_t>& out;
+	std::uint64_t bits = 0;
+	int count = 0;
+
+	void Put(std::uint32_t value, int length)
+	{
+		bits |= std::uint64_t(value) << count;
+		count += length;
+		for (; count >= 8; count -= 8, bits >>= 8)
+			out.push_back(std::uint8_t(bits));
+	}
+
+	void Align()
+	{
+		if (count) Put(0, 8 - count);
+	}
+};
+
+// Code and length of a symbol, the code is bit reversed so it can be written as it is
+struct HuffmanCode final { std::uint16_t code, length; };
+
+static constexpr std::uint16_t reverse_bits(std::uint16_t code, int length)
+{
+	std::uint16_t result = 0;
+	for (int i = 0; i < length; i++)
+		result |= ((code >> i) & 1) << (length - 1 - i);
+	return result;
+}
+
+// Fixed Huffman codes of deflate literals and lengths (RFC 1951, 3.2.6)
+static constexpr auto fixed_literal_codes = [] {
+	std::array<HuffmanCode, 288> codes{};
+	for (int i = 0; i < 288; i++)
+	{
+		if (i < 144) codes[i] = { reverse_bits(std::uint16_t(0x30 + i), 8), 8 };
+		else if (i < 256) codes[i] = { reverse_bits(std::uint16_t(0x190 + i - 144), 9), 9 };
+		else if (i < 280) codes[i] = { reverse_bits(std::uint16_t(i - 256), 7), 7 };
+		else codes[i] = { reverse_bits(std::uint16_t(0xC0 + i - 280), 8), 8 };
+	}
+	return codes;
+}();
+
+static constexpr std::uint16_t length_base[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static constexpr std::uint8_t length_extra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static constexpr std::uint16_t distance_base[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static constexpr std::uint8_t distance_extra[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static void put_symbol(BitWriter& writer, int symbol)
+{
+	writer.Put(fixed_literal_codes[symbol].code, fixed_literal_codes[symbol].length);
+}
+
+static void put_match(BitWriter& writer, int length, int distance)
+{
+	int l = int(std::upper_bound(std::begin(length_base), std::end(length_base), length) - std::begin(length_base)) - 1;
+	put_symbol(writer, 257 + l);
+	writer.Put(length - length_base[l], length_extra[l]);
+	int d = int(std::upper_bound(std::begin(distance_base), std::end(distance_base), distance) - std::begin(distance_base)) - 1;
+	writer.Put(reverse_bits(std::uint16_t(d), 5), 5);
+	writer.Put(distance - distance_base[d], distance_extra[d]);
+}
+
+// Deflate the data as non-final blocks ending byte aligned, so independently compressed parts can be concatenated
+static void deflate_part(std::uint8_t const* data, std::size_t size, int level, std::vector<std::uint8_t>& out)
+{
+	BitWriter writer{ out };
+	if (level == 0)
+	{
+		for (std::size_t offset = 0; offset < size; offset += 65535)
+		{
+			auto length = std::uint16_t(std::min<std::size_t>(65535, size - offset));
+			writer.Put(0, 3); // not final, stored
+			writer.Align();
+			out.insert(out.end(), { std::uint8_t(length), std::uint8_t(length >> 8), std::uint8_t(~length), std::uint8_t(~length >> 8) });
+			out.insert(out.end(), data + offset, data + offset + length);
+		}
+		return;
+	}
+
+	static constexpr int hash_bits = 15, window = 32768;
+	std::vector<std::int32_t> head(1 << hash_bits, -1);
+	auto hash = [&](std::size_t i) { return ((data[i] << 16 | data[i + 1] << 8 | data[i + 2]) * 2654435761u) >> (32 - hash_bits); };
+	writer.Put(0b010, 3); // not final, fixed Huffman codes
+	std::size_t i = 0;
+	while (i + 3 <= size)
+	{
+		auto h = hash(i);
+		std::int32_t candidate = head[h];
+		head[h] = std::int32_t(i);
+		if (candidate >= 0 && i - candidate <= window && !std::memcmp(data + candidate, data + i, 3))
+		{
+			std::size_t length = 3, max_length = std::min<std::size_t>(258, size - i);
+			while (length < max_length && data[candidate + length] == data[i + length]) length++;
+			put_match(writer, int(length), int(i - candidate));
+			for (std::size_t k = i + 1; k < i + length && k + 3 <= size; k++)
+				head[hash(k)] = std::int32_t(k);
+			i += length;
+		}
+		else put_symbol(writer, data[i++]);
+	}
+	for (; i < size; i++) put_symbol(writer, data[i]);
+	put_symbol(writer, 256); // end of block
+
+	// empty stored block to end byte aligned
+	writer.Put(0, 3);
+	writer.Align();
+	out.insert(out.end(), { 0x00, 0x00, 0xFF, 0xFF });
+}
+
+static constexpr std::uint32_t adler_base = 65521;
+
+static std::uint32_t adler32(std::uint8_t const* data, std::size_t size)
+{
+	std::uint32_t a = 1, b = 0;
+	while (size)
+	{
+		std::size_t n = std::min<std::size_t>(size, 5552); // the largest n before b overflows
+		for (std::size_t i = 0; i < n; i++)
+			a += data[i], b += a;
+		a %= adler_base, b %= adler_base;
+		data += n, size -= n;
+	}
+	return b << 16 | a;
+}
+
+// Checksum of two concatenated parts from the checksums of each part
+static std::uint32_t adler32_combine(std::uint32_t adler1, std::uint32_t adler2, std::size_t size2)
+{
+	std::uint32_t rem = std::uint32_t(size2 % adler_base);
+	std::uint32_t sum1 = adler1 & 0xFFFF;
+	std::uint32_t sum2 = std::uint32_t(std::uint64_t(rem) * sum1 % adler_base);
+	sum1 += (adler2 & 0xFFFF) + adler_base - 1;
+	sum2 += (adler1 >> 16) + (adler2 >> 16) + adler_base - rem;
+	if (sum1 >= adler_base) sum1 -= adler_base;
+	if (sum1 >= adler_base) sum1 -= adler_base;
+	if (sum2 >= adler_base * 2) sum2 -= adler_base * 2;
+	if (sum2 >= adler_base) sum2 -= adler_base;
+	return sum2 << 16 | sum1;
+}
+
+// CRC-32 with slicing by 8 bytes
+static std::uint32_t crc32(std::uint8_t const* data, std::size_t size, std::uint32_t crc = 0)
+{
+	static constexpr auto tables = [] {
+		std::array<std::array<std::uint32_t, 256>, 8> tables{};
+		for (std::uint32_t i = 0; i < 256; i++)
+		{
+			std::uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			tables[0][i] = c;
+		}
+		for (int k = 1; k < 8; k++)
+			for (int i = 0; i < 256; i++)
+				tables[k][i] = (tables[k - 1][i] >> 8) ^ tables[0][tables[k - 1][i] & 0xFF];
+		return tables;
+	}();
+	auto load = [](std::uint8_t const* p) { return std::uint32_t(p[0]) | p[1] << 8 | p[2] << 16 | std::uint32_t(p[3]) << 24; };
+
+	crc = ~crc;
+	for (; size >= 8; data += 8, size -= 8)
+	{
+		std::uint32_t lo = crc ^ load(data), hi = load(data + 4);
+		crc = tables[7][lo & 0xFF] ^ tables[6][(lo >> 8) & 0xFF] ^ tables[5][(lo >> 16) & 0xFF] ^ tables[4][lo >> 24]
+			^ tables[3][hi & 0xFF] ^ tables[2][(hi >> 8) & 0xFF] ^ tables[1][(hi >> 16) & 0xFF] ^ tables[0][hi >> 24];
+	}
+	for (; size; data++, size--)
+		crc = tables[0][(crc ^ *data) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+// Apply a PNG filter to a row, returns the sum of absolute values of the result (as signed bytes)
+// @param out: where the filtered bytes are written if Write is true
+template<int Filter, bool Write>
+static std::uint32_t filter_row(std::uint8_t const* row, std::uint8_t const* up, std::size_t size, int bpp, std::uint8_t* out)
+{
+	std::uint32_t sum = 0;
+	auto apply = [&](std::size_t i, int a, int c) {
+		int b = up[i], predictor = 0;
+		if constexpr (Filter == 1) predictor = a;
+		else if constexpr (Filter == 2) predictor = b;
+		else if constexpr (Filter == 3) predictor = (a + b) >> 1;
+		else if constexpr (Filter == 4)
+		{
+			int pa = std::abs(b - c), pb = std::abs(a - c), pc = std::abs(a + b - c - c);
+			predictor = pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+		}
+		auto value = std::uint8_t(row[i] - predictor);
+		if constexpr (Write) out[i] = value;
+		else sum += std::abs(std::int8_t(value));
+	};
+	// the first pixel has no left neighbour
+	for (std::size_t i = 0; i < std::size_t(bpp); i++) apply(i, 0, 0);
+	for (std::size_t i = bpp; i < size; i++) apply(i, row[i - bpp], up[i - bpp]);
+	return sum;
+}
+
+// Filter the rows with the filter of the smallest sum of absolute differences, as most encoders do
+static void filter_rows(ImageView const& image, int begin, int end, std::uint8_t* out)
+{
+	using FilterFunction = std::uint32_t(*)(std::uint8_t const*, std::uint8_t const*, std::size_t, int, std::uint8_t*);
+	static constexpr FilterFunction sums[] = { filter_row<0, false>, filter_row<1, false>, filter_row<2, false>, filter_row<3, false>, filter_row<4, false> };
+	static constexpr FilterFunction writes[] = { filter_row<0, true>, filter_row<1, true>, filter_row<2, true>, filter_row<3, true>, filter_row<4, true> };
+	std::size_t row_size = std::size_t(image.size[0]) * image.channels;
+	std::vector<std::uint8_t> zero(row_size, 0);
+	for (int y = begin; y < end; y++, out += row_size + 1)
+	{
+		std::uint8_t const* row = image.pixels + y * image.row_pitch;
+		std::uint8_t const* up = y ? row - image.row_pitch : zero.data();
+		int best = 0;
+		std::uint32_t best_sum = UINT32_MAX;
+		for (int filter = 0; filter < 5; filter++)
+			if (std::uint32_t sum = sums[filter](row, up, row_size, image.channels, nullptr); sum < best_sum)
+				best = filter, best_sum = sum;
+		out[0] = std::uint8_t(best);
+		writes[best](row, up, row_size, image.channels, out + 1);
+	}
+}
+
+static void put_chunk(std::vector<std::uint8_t>& out, char const* type, std::uint8_t const* data, std::size_t size)
+{
+	put_u32_be(out, std::uint32_t(size));
+	std::size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data, data + size);
+	put_u32_be(out, crc32(out.data() + start, size + 4));
+}
+
+std::vector<std::uint8_t> EncodePNG(ImageView image, int level, unsigned threads)
+{
+	static constexpr std::uint8_t color_types[] = { 0, 4, 2, 6 }; // gray, gray alpha, RGB, RGBA
+	MATHYW_ASSERT(image.channels >= 1 && image.channels <= 4, "PNG expects 1 to 4 channels");
+	std::size_t row_size = std::size_t(image.size[0]) * image.channels + 1;
+	if (!threads) threads = std::max(1u, std::thread::hardware_concurrency());
+
+	// parts of at least 256 KiB, a smaller part compresses worse than it gains in parallelism
+	int rows_per_part = std::max(int((image.size[1] + threads - 1) / threads), int((256 << 10) / row_size) + 1);
+	int parts = std::max(1, (image.size[1] + rows_per_part - 1) / rows_per_part);
+	std::vector<std::vector<std::uint8_t>> compressed(parts);
+	std::vector<std::uint32_t> checksums(parts);
+	std::vector<std::size_t> sizes(parts);
+	auto compress = [&](int part) {
+		int begin = part * rows_per_part, end = std::min(image.size[1], begin + rows_per_part);
+		std::vector<std::uint8_t> filtered(row_size * (end - begin));
+		filter_rows(image, begin, end, filtered.data());
+		checksums[part] = adler32(filtered.data(), filtered.size());
+		sizes[part] = filtered.size();
+		compressed[part].reserve(filtered.size() / 2);
+		deflate_part(filtered.data(), filtered.size(), level, compressed[part]);
+	};
+	std::vector<std::thread> workers;
+	for (int part = 1; part < parts; part++)
+		workers.emplace_back(compress, part);
+	compress(0);
+	for (auto& worker : workers) worker.join();
+
+	std::vector<std::uint8_t> zlib = { 0x78, 0x01 };
+	std::uint32_t checksum = 1;
+	for (int part = 0; part < parts; part++)
+	{
+		zlib.insert(zlib.end(), compressed[part].begin(), compressed[part].end());
+		checksum = adler32_combine(checksum, checksums[part], sizes[part]);
+	}
+	BitWriter writer{ zlib };
+	writer.Put(0b011, 3); // final, fixed Huffman codes
+	put_symbol(writer, 256);
+	writer.Align();
+	put_u32_be(zlib, checksum);
+
+	std::vector<std::uint8_t> out = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	std::vector<std::uint8_t> header;
+	put_u32_be(header, image.size[0]);
+	put_u32_be(header, image.size[1]);
+	header.insert(header.end(), { 8, color_types[image.channels - 1], 0, 0, 0 });
+	put_chunk(out, "IHDR", header.data(), header.size());
+	put_chunk(out, "IDAT", zlib.data(), zlib.size());
+	put_chunk(out, "IEND", nullptr, 0);
+	return out;
+}
+
+bool WriteImage(std::string const& path, ImageView image, unsigned threads)
+{
+	bool qoi = path.ends_with(".qoi");
+	MATHYW_ASSERT(qoi || path.ends_with(".png"), "Unknown image format of \"" + path + "\"");
+	auto data = qoi ? EncodeQOI(image) : EncodePNG(image, 1, threads);
+	std::ofstream ofs(path, std::ios::binary);
+	if (!ofs) return false;
+	ofs.write((char const*)data.data(), data.size());
+	ofs.close();
+	return !ofs.fail();
+}
+
+Image ReadTexture(Texture& texture)
+{
+	static constexpr GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+	Image image{ texture.Size(), texture.Channels(), {} };
+	std::size_t row_size = std::size_t(image.size[0]) * image.channels;
+	std::vector<std::uint8_t> pixels(row_size * image.size[1]);
+
+	auto& state = GLStateCache::Current();
+	state.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	state.BindTexture(GL_TEXTURE_2D, texture.textureid);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_2D, 0, formats[image.channels - 1], GL_UNSIGNED_BYTE, pixels.data());
+
+	image.pixels.resize(pixels.size());
+	for (int y = 0; y < image.size[1]; y++)
+		std::memcpy(image.pixels.data() + row_size * y, pixels.data() + row_size * (image.size[1] - 1 - y), row_size);
+	return image;
+}
+
+} // !Mathyw
@@ -0,0 +1,79 @@
+#include <Mathyw/input_state.hpp>
+
+namespace Mathyw {
+
+static_assert(std::is_trivially_copyable_v<InputSnapshot>, "InputSnapshot is copied word by word");
+
+void InputSnapshot::Key(KeyCode key, bool down)
+{
+	if (key < 0 || key >= key_count) return;
+	std::uint64_t bit = 1ull << (key % 64);
+	auto& word = keys[key / 64];
+	if (down) word |= bit, keys_pressed[key / 64] |= bit;
+	else word &= ~bit, keys_released[key / 64] |= bit;
+}
+
+void InputSnapshot::Button(MouseButton button, bool down)
+{
+	if (button < 0 || button >= button_count) return;
+	auto bit = std::uint8_t(1 << button);
+	if (down) buttons |= bit, buttons_pressed |= bit;
+	else buttons &= ~bit, buttons_released |= bit;
+}
+
+void InputSnapshot::NextFrame()
+{
+	keys_pressed.fill(0);
+	keys_released.fill(0);
+	buttons_pressed = buttons_released = 0;
+	scroll = Ivec2(0, 0);
+	frame++;
+}
+
+InputState::InputState()
+	: latest(0)
+{
+	for (auto& slot : slots)
+	{
+		slot.sequence.store(0, std::memory_order_relaxed);
+		for (auto& word : slot.data)
+			word.store(0, std::memory_order_relaxed);
+	}
+	Publish(InputSnapshot());
+}
+
+void InputState::Publish(InputSnapshot const& snapshot)
+{
+	std::array<std::uint64_t, words> buffer{};
+	std::memcpy(buffer.data(), &snapshot, sizeof(snapshot));
+
+	int index = (latest.load(std::memory_order_relaxed) + 1) % slot_count;
+	auto& slot = slots[index];
+	auto sequence = slot.sequence.load(std::memory_order_relaxed);
+	slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	for (std::size_t i = 0; i < words; i++)
+		slot.data[i].store(buffer[i], std::memory_order_relaxed);
+	slot.sequence.store(sequence + 2, std::memory_order_release);
+	latest.store(index, std::memory_order_release);
+}
+
+InputSnapshot InputState::Read() const
+{
+	std::array<std::uint64_t, words> buffer;
+	for (;;)
+	{
+		auto& slot = slots[latest.load(std::memory_order_acquire)];
+		auto sequence = slot.sequence.load(std::memory_order_acquire);
+		if (sequence & 1) continue;
+		for (std::size_t i = 0; i < words; i++)
+			buffer[i] = slot.data[i].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) == sequence) break;
+	}
+	InputSnapshot snapshot;
+	std::memcpy(static_cast<void*>(&snapshot), buffer.data(), sizeof(snapshot)); // trivially copyable, see the assertion above
+	return snapshot;
+}
+
+} // !Mathyw
@@ -0,0 +1,229 @@
+#include <Mathyw/mesh_pool.hpp>
+#include <Mathyw/state_cache.hpp>
+#include <algorithm>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+namespace Mathyw {
+
+std::uint32_t MeshPool::FreeList::Allocate(std::uint32_t count)
+{
+	if (count == 0) return 0;
+	for (auto i = 0u; i < blocks.size(); i++)
+	{
+		auto& block = blocks[i];
+		if (block.count < count) continue;
+		std::uint32_t offset = block.offset;
+		block.offset += count;
+		block.count -= count;
+		if (!block.count) blocks.erase(blocks.begin() + i);
+		return offset;
+	}
+	return ~0u;
+}
+
+void MeshPool::FreeList::Free(std::uint32_t offset, std::uint32_t count)
+{
+	if (count == 0) return;
+	auto it = std::lower_bound(blocks.begin(), blocks.end(), offset,
+		[](Block const& block, std::uint32_t offset) { return block.offset < offset; });
+	it = blocks.insert(it, Block{ offset, count });
+
+	// merge with the next block, then with the previous one
+	if (it + 1 != blocks.end() && it->offset + it->count == (it + 1)->offset)
+	{
+		it->count += (it + 1)->count;
+		blocks.erase(it + 1);
+	}
+	if (it != blocks.begin() && (it - 1)->offset + (it - 1)->count == it->offset)
+	{
+		(it - 1)->count += it->count;
+		blocks.erase(it);
+	}
+}
+
+std::uint32_t MeshPool::FreeList::Largest() const
+{
+	std::uint32_t res = 0;
+	for (auto const& block : blocks)
+		res = std::max(res, block.count);
+	return res;
+}
+
+MeshPool::MeshPool(VertexLayout layout, std::uint32_t vertex_capacity, std::uint32_t index_capacity,
+	IndexType type, Primitives primitive)
+	: vao((int)vertex_capacity, primitive), layout(layout),
+	vertex_capacity(vertex_capacity), index_capacity(index_capacity), used_vertices(0), used_indices(0),
+	index_size(type == IndexType::Uint32 ? 4 : 2)
+{
+	MATHYW_ASSERT(type == IndexType::Uint16 || type == IndexType::Uint32,
+		"MeshPool index type must be Uint16 or Uint32");
+	vao.LinkVBO(std::span<std::byte const>(), layout, BufferUsage::Dynamic);
+	if (index_capacity)
+		vao.LinkIndices(nullptr, index_capacity, index_size == 4 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT);
+	vertex_free.blocks.emplace_back(0u, vertex_capacity);
+	index_free.blocks.emplace_back(0u, index_capacity);
+}
+
+Mesh MeshPool::Add(std::span<std::byte const> vertices, std::span<unsigned const> indices)
+{
+	MATHYW_ASSERT(vertices.size() % layout.stride == 0, "MeshPool vertices size must be a multiple of the stride");
+	auto vcount = (std::uint32_t)(vertices.size() / layout.stride);
+	auto icount = (std::uint32_t)indices.size();
+	if (vertex_free.Largest() < vcount || index_free.Largest() < icount)
+	{
+		if (vertex_capacity - used_vertices < vcount || index_capacity - used_indices < icount)
+			return Mesh();
+		Defragment();
+	}
+
+	MeshRange range = { vertex_free.Allocate(vcount), vcount, index_free.Allocate(icount), icount };
+	used_vertices += vcount, used_indices += icount;
+	if (vcount) vao.UpdateVBO(0, vertices, std::size_t(range.vertex_offset) * layout.stride);
+
+	if (icount)
+	{
+		// the copy target keeps the element array binding of whichever vao is bound untouched
+		GLStateCache::Current().BindBuffer(GL_COPY_WRITE_BUFFER, vao.iboid);
+		if (index_size == 2)
+		{
+			std::vector<std::uint16_t> narrow(icount);
+			for (auto i = 0u; i < icount; i++)
+			{
+				MATHYW_ASSERT(indices[i] <= 0xFFFF, "Index does not fit in the index type of MeshPool");
+				narrow[i] = (std::uint16_t)indices[i];
+			}
+			glBufferSubData(GL_COPY_WRITE_BUFFER, range.index_offset * 2, icount * 2, narrow.data());
+		}
+		else glBufferSubData(GL_COPY_WRITE_BUFFER, range.index_offset * 4, icount * 4, indices.data());
+	}
+
+	Mesh mesh;
+	if (free_ids.empty())
+	{
+		mesh.id = (std::uint32_t)meshes.size();
+		meshes.push_back(range);
+		alive.push_back(true);
+	}
+	else
+	{
+		mesh.id = free_ids.back();
+		free_ids.pop_back();
+		meshes[mesh.id] = range;
+		alive[mesh.id] = true;
+	}
+	return mesh;
+}
+
+void MeshPool::Update(Mesh mesh, std::span<std::byte const> data, std::size_t offset)
+{
+	MeshRange range = Range(mesh);
+	MATHYW_ASSERT(offset + data.size() <= std::size_t(range.vertex_count) * layout.stride,
+		"MeshPool::Update data exceeds the mesh size");
+	vao.UpdateVBO(0, data, std::size_t(range.vertex_offset) * layout.stride + offset);
+}
+
+void MeshPool::Remove(Mesh mesh)
+{
+	MeshRange range = Range(mesh);
+	vertex_free.Free(range.vertex_offset, range.vertex_count);
+	index_free.Free(range.index_offset, range.index_count);
+	used_vertices -= range.vertex_count, used_indices -= range.index_count;
+	alive[mesh.id] = false;
+	free_ids.push_back(mesh.id);
+}
+
+MeshRange MeshPool::Range(Mesh mesh) const
+{
+	MATHYW_ASSERT(mesh && mesh.id < meshes.size() && alive[mesh.id], "Invalid mesh handle in MeshPool");
+	return meshes[mesh.id];
+}
+
+// A region of a buffer to be moved
+struct BufferMove final { std::size_t from, to, size; };
+
+// Move regions of a buffer through a scratch buffer, since copies within one buffer must not overlap
+// @param used: size of the compacted data in bytes
+static void move_buffer_regions(std::uint32_t buffer, std::size_t used, std::vector<BufferMove> const& moves)
+{
+	if (moves.empty()) return;
+	auto& state = GLStateCache::Current();
+	unsigned scratch;
+	glGenBuffers(1, &scratch);
+	state.BindBuffer(GL_COPY_READ_BUFFER, buffer);
+	state.BindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+	glBufferData(GL_COPY_WRITE_BUFFER, used, nullptr, GL_STREAM_COPY);
+	for (auto const& move : moves)
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, move.from, move.to, move.size);
+	state.BindBuffer(GL_COPY_READ_BUFFER, scratch);
+	state.BindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+	glDeleteBuffers(1, &scratch);
+	state.BufferDeleted(scratch);
+}
+
+void MeshPool::Defragment()
+{
+	std::vector<std::uint32_t> order;
+	for (auto i = 0u; i < meshes.size(); i++)
+		if (alive[i]) order.push_back(i);
+
+	// indices are local to each mesh, so vertices and indices can be compacted independently
+	std::vector<BufferMove> moves;
+	std::sort(order.begin(), order.end(),
+		[&](auto a, auto b) { return meshes[a].vertex_offset < meshes[b].vertex_offset; });
+	std::uint32_t cursor = 0;
+	for (auto id : order)
+	{
+		auto& range = meshes[id];
+		if (range.vertex_count)
+			moves.emplace_back(std::size_t(range.vertex_offset) * layout.stride,
+				std::size_t(cursor) * layout.stride, std::size_t(range.vertex_count) * layout.stride);
+		range.vertex_offset = cursor;
+		cursor += range.vertex_count;
+	}
+	move_buffer_regions(vao.vbos[0].id, std::size_t(cursor) * layout.stride, moves);
+	vertex_free.blocks.clear();
+	if (cursor < vertex_capacity) vertex_free.blocks.emplace_back(cursor, vertex_capacity - cursor);
+
+	moves.clear();
+	std::sort(order.begin(), order.end(),
+		[&](auto a, auto b) { return meshes[a].index_offset < meshes[b].index_offset; });
+	cursor = 0;
+	for (auto id : order)
+	{
+		auto& range = meshes[id];
+		if (range.index_count)
+			moves.emplace_back(std::size_t(range.index_offset) * index_size,
+				std::size_t(cursor) * index_size, std::size_t(range.index_count) * index_size);
+		range.index_offset = cursor;
+		cursor += range.index_count;
+	}
+	move_buffer_regions(vao.iboid, std::size_t(cursor) * index_size, moves);
+	index_free.blocks.clear();
+	if (cursor < index_capacity) index_free.blocks.emplace_back(cursor, index_capacity - cursor);
+}
+
+void MeshPool::DrawRange(MeshRange const& range)
+{
+	if (range.index_count)
+		glDrawElementsBaseVertex((unsigned)vao.primitives, range.index_count, vao.index_type,
+			(void*)(std::size_t(range.index_offset) * index_size), range.vertex_offset);
+	else glDrawArrays((unsigned)vao.primitives, range.vertex_offset, range.vertex_count);
+}
+
+void MeshPool::Draw(Mesh mesh)
+{
+	MeshRange range = Range(mesh);
+	vao.Bind();
+	DrawRange(range);
+}
+
+void MeshPool::Draw(std::span<Mesh const> list)
+{
+	vao.Bind();
+	for (auto mesh : list)
+		DrawRange(Range(mesh));
+}
+
+} // !Mathyw
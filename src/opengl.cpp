@@ -1,4 +1,6 @@
 #include <Mathyw/opengl.hpp>
+#include <cstdlib>
+#include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 namespace Mathyw {
@@ -25,8 +27,38 @@ void ExitGL()
 	glfw_should_terminate = false;
 }
 
+void GLContextVersion(int major, int minor)
+{
+	InitGL();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, major);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, minor);
+}
+
+bool GLSupports(int major, int minor)
+{
+	int cur_major = 0, cur_minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &cur_major);
+	glGetIntegerv(GL_MINOR_VERSION, &cur_minor);
+	return cur_major > major || (cur_major == major && cur_minor >= minor);
+}
+
+bool GLSupports(char const* extension)
+{
+	return glfwExtensionSupported(extension);
+}
+
+void* GLProcAddress(char const* name)
+{
+	return (void*)glfwGetProcAddress(name);
+}
+
 GLFWManager::GLFWManager()
 {
+#if defined(GLFW_PLATFORM_NULL) && MATHYW_PLATFORM == MATHYW_LINUX
+	// without a display only headless windows can be created, through the null platform and OSMesa
+	if (!std::getenv("DISPLAY") && !std::getenv("WAYLAND_DISPLAY"))
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
 	MATHYW_VERIFY(glfwInit(), "GLFW initialization failed");
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
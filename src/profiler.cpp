@@ -0,0 +1,317 @@
+#include <Mathyw/profiler.hpp>
+#include <Mathyw/clock.hpp>
+#include <Mathyw/opengl.hpp>
+#include <Mathyw/state_cache.hpp>
+#include <Mathyw/transformation.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+namespace Mathyw {
+
+// The p-th percentile of the values, reorders them
+static double percentile(std::vector<float>& values, double p)
+{
+	if (values.empty()) return 0.0;
+	auto nth = values.begin() + (std::ptrdiff_t)(p * (values.size() - 1) + 0.5);
+	std::nth_element(values.begin(), nth, values.end());
+	return *nth;
+}
+
+Profiler::Profiler(std::size_t history, int latency)
+	: frames(std::max(latency, 1)), frame_index(0), history(std::max<std::size_t>(history, 1)), history_count(0),
+	max_trace(0), dropped(0), gpu_enabled(GPUSupported()), tracing(false), destruct_this(true)
+{
+}
+
+Profiler::Profiler(Profiler&& profiler) noexcept
+	: frames(std::move(profiler.frames)), frame_index(profiler.frame_index), history(profiler.history),
+	history_count(profiler.history_count), scopes(std::move(profiler.scopes)), scope_ids(std::move(profiler.scope_ids)),
+	stack(std::move(profiler.stack)), trace(std::move(profiler.trace)), max_trace(profiler.max_trace),
+	dropped(profiler.dropped), gpu_enabled(profiler.gpu_enabled), tracing(profiler.tracing), destruct_this(true)
+{
+	profiler.destruct_this = false;
+}
+
+Profiler::~Profiler()
+{
+	if (!destruct_this) return;
+	for (auto& frame : frames)
+		if (!frame.queries.empty())
+			glDeleteQueries((GLsizei)frame.queries.size(), frame.queries.data());
+}
+
+bool Profiler::GPUSupported()
+{
+	static bool supported = [] {
+		if (!GLSupports(3, 3) && !GLSupports("GL_ARB_timer_query")) return false;
+		int bits = 0;
+		glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+		return bits > 0;
+	}();
+	return supported;
+}
+
+void Profiler::BeginFrame()
+{
+	MATHYW_ASSERT(stack.empty(), "Profiler::BeginFrame called before the previous frame ended");
+	frame_index++;
+
+	// read back the frames in flight oldest first (the slot about to be reused), stop at the first one still running on the gpu
+	for (std::size_t i = frames.size(); i > 0; i--)
+	{
+		auto& frame = frames[(frame_index + frames.size() - i) % frames.size()];
+		if (frame.pending && !Resolve(frame)) break;
+	}
+
+	// the ring came back to a frame the gpu has not finished, drop it instead of waiting
+	auto& frame = Current();
+	if (frame.pending && !Resolve(frame))
+	{
+		dropped++;
+		frame.events.clear();
+		frame.used = 0;
+		frame.pending = false;
+	}
+
+	if (gpu_enabled)
+	{
+		GLint64 gpu_now;
+		glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+		frame.gpu_offset = Clock::Now() - gpu_now;
+	}
+	Begin("Frame");
+}
+
+void Profiler::EndFrame()
+{
+	End();
+	MATHYW_ASSERT(stack.empty(), "Profiler::EndFrame called with scopes not ended");
+	Current().pending = true;
+}
+
+void Profiler::Begin(std::string_view name, bool gpu)
+{
+	auto& frame = Current();
+	auto id = ScopeId(name, (std::uint32_t)stack.size());
+	stack.push_back((std::uint32_t)frame.events.size());
+	int query = gpu && gpu_enabled ? Timestamp(frame) : -1;
+	frame.events.push_back(Event{ id, Clock::Now(), 0, query, -1 });
+}
+
+void Profiler::End()
+{
+	MATHYW_ASSERT(!stack.empty(), "Profiler::End called without a scope");
+	auto& frame = Current();
+	auto& event = frame.events[stack.back()];
+	stack.pop_back();
+	event.cpu_end = Clock::Now();
+	if (event.gpu_begin >= 0) event.gpu_end = Timestamp(frame);
+}
+
+std::uint32_t Profiler::ScopeId(std::string_view name, std::uint32_t depth)
+{
+	auto [it, inserted] = scope_ids.try_emplace(HashString(name), (std::uint32_t)scopes.size());
+	if (inserted)
+		scopes.push_back(History{ std::string(name), depth, 0, std::vector<float>(history), std::vector<float>(history) });
+	return it->second;
+}
+
+int Profiler::Timestamp(Frame& frame)
+{
+	if (frame.used == frame.queries.size())
+	{
+		// grow the pool of the frame, the queries are reused from now on
+		auto count = std::max<std::size_t>(frame.queries.size(), 16);
+		frame.queries.resize(frame.queries.size() + count);
+		glGenQueries((GLsizei)count, frame.queries.data() + frame.used);
+	}
+	glQueryCounter(frame.queries[frame.used], GL_TIMESTAMP);
+	return (int)frame.used++;
+}
+
+bool Profiler::Resolve(Frame& frame)
+{
+	// queries finish in order, the last one being available means every one is
+	std::vector<GLuint64> times(frame.used);
+	if (frame.used)
+	{
+		GLuint available = 0;
+		glGetQueryObjectuiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return false;
+		for (std::uint32_t i = 0; i < frame.used; i++)
+			glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &times[i]);
+	}
+
+	// sum the calls of each scope into this frame of the rolling history
+	auto slot = history_count++ % history;
+	for (auto& scope : scopes)
+		scope.cpu[slot] = scope.gpu[slot] = 0.0f, scope.calls = 0;
+	for (auto const& event : frame.events)
+	{
+		auto& scope = scopes[event.name];
+		scope.calls++;
+		scope.cpu[slot] += (float)((event.cpu_end - event.cpu_begin) * 1e-6);
+		if (event.gpu_begin >= 0)
+			scope.gpu[slot] += (float)((times[event.gpu_end] - times[event.gpu_begin]) * 1e-6);
+
+		if (!tracing || trace.size() + 2 > max_trace) continue;
+		trace.push_back(TraceEvent{ event.name, false, event.cpu_begin, event.cpu_end });
+		if (event.gpu_begin >= 0)
+			trace.push_back(TraceEvent{ event.name, true,
+				(std::int64_t)times[event.gpu_begin] + frame.gpu_offset, (std::int64_t)times[event.gpu_end] + frame.gpu_offset });
+	}
+
+	frame.events.clear();
+	frame.used = 0;
+	frame.pending = false;
+	return true;
+}
+
+std::vector<ProfileStats> Profiler::Stats() const
+{
+	std::vector<ProfileStats> stats;
+	stats.reserve(scopes.size());
+	auto count = std::min(history_count, history);
+	auto last = (history_count + history - 1) % history;
+	std::vector<float> values(count);
+	for (auto const& scope : scopes)
+	{
+		ProfileStats s;
+		s.name = scope.name;
+		s.depth = scope.depth;
+		if (count)
+		{
+			s.calls = scope.calls;
+			s.cpu = scope.cpu[last];
+			s.gpu = scope.gpu[last];
+			std::copy_n(scope.cpu.begin(), count, values.begin());
+			s.cpu_p50 = percentile(values, 0.50);
+			s.cpu_p95 = percentile(values, 0.95);
+			s.cpu_p99 = percentile(values, 0.99);
+			std::copy_n(scope.gpu.begin(), count, values.begin());
+			s.gpu_p50 = percentile(values, 0.50);
+			s.gpu_p95 = percentile(values, 0.95);
+			s.gpu_p99 = percentile(values, 0.99);
+		}
+		stats.push_back(s);
+	}
+	return stats;
+}
+
+void Profiler::StartTrace(std::size_t max_events)
+{
+	trace.clear();
+	trace.reserve(std::min<std::size_t>(max_events, 1 << 16));
+	max_trace = max_events;
+	tracing = true;
+}
+
+bool Profiler::WriteTrace(std::string const& path) const
+{
+	auto file = std::fopen(path.c_str(), "wb");
+	if (!file) return false;
+
+	std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+	std::fputs("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n", file);
+	std::fputs("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}", file);
+
+	// names are escaped once, timestamps are microseconds from the first recorded scope
+	std::vector<std::string> names(scopes.size());
+	for (std::size_t i = 0; i < scopes.size(); i++)
+		for (char c : scopes[i].name)
+		{
+			if (c == '"' || c == '\\') names[i] += '\\', names[i] += c;
+			else if ((unsigned char)c >= 0x20) names[i] += c;
+		}
+	std::int64_t origin = trace.empty() ? 0 : trace.front().begin;
+	for (auto const& event : trace)
+		origin = std::min(origin, event.begin);
+	for (auto const& event : trace)
+		std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			names[event.name].c_str(), event.gpu ? "gpu" : "cpu", event.gpu ? 2 : 1,
+			(event.begin - origin) * 1e-3, (event.end - event.begin) * 1e-3);
+
+	std::fputs("\n]}\n", file);
+	return std::fclose(file) == 0;
+}
+
+static char const* overlay_vertex = R"(#version 330 core
+layout(location = 0) in vec2 position;
+uniform mat4 projection;
+uniform mat4 model;
+out vec2 uv;
+void main()
+{
+	uv = position + 0.5;
+	gl_Position = projection * model * vec4(position, 0.0, 1.0);
+})";
+
+static char const* overlay_fragment = R"(#version 330 core
+in vec2 uv;
+uniform sampler2D glyph;
+uniform vec4 color;
+out vec4 frag_color;
+void main()
+{
+	frag_color = vec4(color.rgb, color.a * texture(glyph, uv).r);
+})";
+
+ProfilerOverlay::ProfilerOverlay(Font& font)
+	: font(font), shader(overlay_vertex, overlay_fragment), quad(6)
+{
+	float vertices[] = {
+		-0.5f, -0.5f, 0.5f, -0.5f, 0.5f, 0.5f,
+		-0.5f, -0.5f, 0.5f, 0.5f, -0.5f, 0.5f
+	};
+	quad.LinkVBO(vertices, VertexLayout(2));
+}
+
+void ProfilerOverlay::Draw(Profiler const& profiler, Ivec2 viewport, Fvec4 color)
+{
+	auto stats = profiler.Stats();
+
+	// one line per scope, the texts are kept so their storage is reused every frame
+	while (lines.size() < stats.size() + 1) lines.emplace_back(font, "");
+	lines[0] = "cpu / gpu ms: last  p50  p95  p99";
+	char buffer[256];
+	for (std::size_t i = 0; i < stats.size(); i++)
+	{
+		auto const& s = stats[i];
+		std::snprintf(buffer, sizeof(buffer), "%*s%.*s  %.2f %.2f %.2f %.2f / %.2f %.2f %.2f %.2f",
+			(int)s.depth * 2, "", (int)std::min<std::size_t>(s.name.size(), 64), s.name.data(),
+			s.cpu, s.cpu_p50, s.cpu_p95, s.cpu_p99, s.gpu, s.gpu_p50, s.gpu_p95, s.gpu_p99);
+		// the font only has printable ascii glyphs
+		for (char* c = buffer; *c; c++)
+			if (*c < 32 || *c > 126) *c = '?';
+		lines[i + 1] = buffer;
+	}
+
+	auto& state = GLStateCache::Current();
+	bool blend = state.IsEnabled(GL_BLEND), depth = state.IsEnabled(GL_DEPTH_TEST);
+	state.Capability(GL_BLEND, true);
+	state.Capability(GL_DEPTH_TEST, false);
+	state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	shader.Bind();
+	shader.Uniform("projection", OrthogonalProjection(0.0f, (float)viewport[0], 0.0f, (float)viewport[1]));
+	shader.Uniform("color", color);
+	shader.Uniform("glyph", 0);
+	float line_height = font['M'].size[1] * 1.5f, margin = 8.0f;
+	for (std::size_t i = 0; i < stats.size() + 1; i++)
+	{
+		Fmat4 origin = Translate(Fvec3(margin, viewport[1] - margin - (i + 1) * line_height, 0.0f));
+		for (auto& character : lines[i].Characters())
+		{
+			shader.Uniform("model", origin * character.model);
+			character.texture.Bind(0);
+			quad.Draw();
+		}
+	}
+
+	state.Capability(GL_BLEND, blend);
+	state.Capability(GL_DEPTH_TEST, depth);
+}
+
+} // !Mathyw
@@ -0,0 +1,91 @@
+#include <Mathyw/render_thread.hpp>
+
+namespace Mathyw {
+
+RenderThread::RenderThread(Window& window)
+	: window(window), recording(0), submitted(false), stop(false), frames(0)
+{
+	// a context could only be current on one thread at a time
+	Window::Bind(nullptr);
+	thread = std::thread(&RenderThread::Loop, this);
+}
+
+RenderThread::~RenderThread()
+{
+	{
+		std::lock_guard lock(mutex);
+		stop = true;
+	}
+	wake.notify_one();
+	thread.join();
+	Window::Bind(&window);
+}
+
+void RenderThread::Submit()
+{
+	std::unique_lock lock(mutex);
+	done.wait(lock, [&] { return !submitted; });
+	submitted = true;
+	recording ^= 1;
+	lock.unlock();
+	wake.notify_one();
+	// the packet recorded next was replayed already, releasing its commands here
+	// sends the resources they held back to the render thread
+	packets[recording].Clear();
+}
+
+void RenderThread::Post(std::function<void()> task)
+{
+	{
+		std::lock_guard lock(mutex);
+		tasks.push_back(std::move(task));
+	}
+	wake.notify_one();
+}
+
+void RenderThread::Destroy(std::function<void()> destroy)
+{
+	if (OnRenderThread()) destroy();
+	else Post(std::move(destroy));
+}
+
+void RenderThread::Loop()
+{
+	render_id = std::this_thread::get_id();
+	Window::Bind(&window);
+	std::unique_lock lock(mutex);
+	for (;;)
+	{
+		wake.wait(lock, [&] { return submitted || stop || !tasks.empty(); });
+		while (!tasks.empty())
+		{
+			auto task = std::move(tasks.front());
+			tasks.pop_front();
+			lock.unlock();
+			task();
+			lock.lock();
+		}
+		if (submitted)
+		{
+			// the simulation records the other packet meanwhile, only this one is touched here
+			auto& packet = packets[recording ^ 1];
+			lock.unlock();
+			for (auto& command : packet.commands)
+				command();
+			window.Present();
+			frames++;
+			lock.lock();
+			submitted = false;
+			done.notify_all();
+		}
+		else if (stop) break;
+	}
+	lock.unlock();
+
+	// the replayed packet still holds resources, release them while the context is current
+	for (auto& packet : packets)
+		packet.Clear();
+	Window::Bind(nullptr);
+}
+
+} // !Mathyw
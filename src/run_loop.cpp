@@ -0,0 +1,80 @@
+#include <Mathyw/run_loop.hpp>
+#include <Mathyw/value_tracker.hpp>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace Mathyw {
+
+static std::int64_t to_nanoseconds(double seconds)
+{
+	return (std::int64_t)(seconds * 1e9);
+}
+
+void SleepUntil(std::int64_t timepoint, double spin)
+{
+	// sleeping overshoots by up to a scheduler quantum, only the end is spun
+	auto remaining = timepoint - Clock::Now() - to_nanoseconds(spin);
+	if (remaining > 0)
+		std::this_thread::sleep_for(std::chrono::nanoseconds(remaining));
+	while (Clock::Now() < timepoint)
+		std::this_thread::yield();
+}
+
+void Run(Window& window, RunConfig const& config,
+	std::function<void(double)> const& update, std::function<void(double)> const& render)
+{
+	std::int64_t step = config.update_rate > 0.0 ? to_nanoseconds(1.0 / config.update_rate) : 0;
+	std::int64_t period = config.frame_rate > 0.0 ? to_nanoseconds(1.0 / config.frame_rate) : 0;
+	std::int64_t previous = Clock::Now(), accumulator = 0, deadline = previous;
+
+	while (window.Active())
+	{
+		bool idle = config.mode == RunMode::OnDemand && !window.data.redraw && !ValueTracker::ActiveCount();
+		if (idle) Window::WaitEvents(config.idle_timeout);
+		else
+		{
+			// low latency: poll the input as late as the estimated frame time allows
+			SleepUntil(window.InputDeadline(), config.spin);
+			Window::PollEvents();
+		}
+		if (!window.Active()) break;
+		window.PublishInput();
+		window.data.redraw = false;
+
+		// the time asleep waiting for events is neither simulated nor counted as a frame
+		std::int64_t now = Clock::Now();
+		std::int64_t elapsed = idle ? 0 : now - previous;
+		previous = now;
+		if (config.stats && !idle) config.stats->Add(elapsed);
+
+		double alpha = 0.0;
+		if (step)
+		{
+			accumulator += elapsed;
+			for (int i = 0; i < config.max_steps && accumulator >= step; i++)
+			{
+				update(step * 1e-9);
+				accumulator -= step;
+			}
+			// too far behind, drop the time instead of spiraling into longer frames
+			if (accumulator >= step) accumulator %= step;
+			alpha = (double)accumulator / step;
+		}
+		else update(elapsed * 1e-9);
+
+		render(alpha);
+		window.Present();
+
+		if (period)
+		{
+			// a frame late by more than a period restarts the schedule instead of bursting to catch up
+			deadline += period;
+			now = Clock::Now();
+			if (deadline < now - period) deadline = now;
+			SleepUntil(deadline, config.spin);
+		}
+	}
+}
+
+} // !Mathyw
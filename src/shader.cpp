@@ -1,16 +1,29 @@
 #include <Mathyw/shader.hpp>
+#include <Mathyw/state_cache.hpp>
+#include <Mathyw/opengl.hpp>
 #include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 namespace Mathyw {
 
-static unsigned create_shader(unsigned type, std::string const& src, bool& good, std::string& err_message)
+// Issue the compilation without waiting for its result
+static unsigned create_shader(unsigned type, std::string const& src)
 {
 	auto shader = glCreateShader(type);
 	const char* cstr = src.c_str();
 	glShaderSource(shader, 1, &cstr, nullptr);
 	glCompileShader(shader);
+	return shader;
+}
+
+// Wait for the compilation and append the error to the message if failed
+static void check_shader(unsigned shader, unsigned type, bool& good, std::string& err_message)
+{
 	int status;
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
 	if (!status)
@@ -22,59 +35,237 @@ static unsigned create_shader(unsigned type, std::string const& src, bool& good,
 		err_message += "Following error found in "
 			+ std::string(type == GL_VERTEX_SHADER ? "vertex shader:\n" : "fragment shader:\n") + buffer;
 	}
-	return shader;
 }
 
-Shader::Shader(std::string const& vertex, std::string const& fragment)
+// GL_KHR_parallel_shader_compile enums and functions, not provided by the 3.3 loader
+static constexpr GLenum gl_completion_status = 0x91B1;
+using MaxShaderCompilerThreadsProc = void (APIENTRYP)(GLuint);
+
+// Returns true if the compilation status can be polled, lets the driver use all its threads on first call
+static bool parallel_compile_supported()
+{
+	static bool supported = [] {
+		char const* name = GLSupports("GL_KHR_parallel_shader_compile") ? "glMaxShaderCompilerThreadsKHR"
+			: GLSupports("GL_ARB_parallel_shader_compile") ? "glMaxShaderCompilerThreadsARB" : nullptr;
+		if (!name) return false;
+		auto max_threads = (MaxShaderCompilerThreadsProc)GLProcAddress(name);
+		if (max_threads) max_threads(0xFFFFFFFF); // no limit, the driver decides
+		return true;
+	}();
+	return supported;
+}
+
+// OpenGL 4.1 program binary enums and functions, not provided by the 3.3 loader
+static constexpr GLenum gl_program_binary_retrievable_hint = 0x8257;
+static constexpr GLenum gl_program_binary_length = 0x8741;
+static constexpr GLenum gl_num_program_binary_formats = 0x87FE;
+using GetProgramBinaryProc = void (APIENTRYP)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+using ProgramBinaryProc = void (APIENTRYP)(GLuint, GLenum, void const*, GLsizei);
+using ProgramParameteriProc = void (APIENTRYP)(GLuint, GLenum, GLint);
+
+// Header of a cached binary file, followed by the binary itself
+struct ProgramBinaryHeader final { std::uint32_t magic, format, length; };
+static constexpr std::uint32_t program_binary_magic = 0x4257544D; // "MTWB"
+
+static std::string shader_cache_directory;
+static ShaderCacheStats shader_cache_stats;
+
+void ShaderCacheDirectory(std::string const& directory)
+{
+	shader_cache_directory = directory;
+}
+
+ShaderCacheStats const& ShaderCacheStatistics()
+{
+	return shader_cache_stats;
+}
+
+// Returns the path of the cached binary, empty if the cache is disabled or unsupported
+static std::string program_binary_path(std::string const& vertex, std::string const& fragment)
+{
+	if (shader_cache_directory.empty()) return {};
+	static bool supported = [] {
+		if (!GLSupports(4, 1) && !GLSupports("GL_ARB_get_program_binary")) return false;
+		int formats = 0;
+		glGetIntegerv(gl_num_program_binary_formats, &formats);
+		return formats > 0;
+	}();
+	if (!supported) return {};
+
+	std::uint64_t hash = HashString({});
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+		hash = HashString((char const*)glGetString(name), hash);
+	hash = HashString(vertex, HashString("\n#vertex\n", hash));
+	hash = HashString(fragment, HashString("\n#fragment\n", hash));
+	char name[24];
+	std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+	return (std::filesystem::path(shader_cache_directory) / name).string();
+}
+
+// Load a cached binary into the program, returns true if the program is linked successfully
+// @param found: set to true if the file exists
+static bool load_program_binary(unsigned program, std::string const& path, bool& found)
+{
+	std::ifstream ifs(path, std::ios::binary);
+	found = ifs.is_open();
+	ProgramBinaryHeader header;
+	if (!ifs.read((char*)&header, sizeof(header)) || header.magic != program_binary_magic) return false;
+	std::vector<char> binary(header.length);
+	if (!ifs.read(binary.data(), binary.size())) return false;
+
+	static auto program_binary = (ProgramBinaryProc)GLProcAddress("glProgramBinary");
+	program_binary(program, header.format, binary.data(), (GLsizei)binary.size());
+	int status;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	return status;
+}
+
+// Store the binary of a linked program, written to a temporary file first so readers never see half a file
+static void save_program_binary(unsigned program, std::string const& path)
 {
+	int length = 0;
+	glGetProgramiv(program, gl_program_binary_length, &length);
+	if (length <= 0) return;
+	std::vector<char> binary(length);
+	GLenum format;
+	static auto get_program_binary = (GetProgramBinaryProc)GLProcAddress("glGetProgramBinary");
+	get_program_binary(program, length, nullptr, &format, binary.data());
+
+	std::error_code ec;
+	std::filesystem::create_directories(shader_cache_directory, ec);
+	std::string temp = path + ".tmp";
+	{
+		std::ofstream ofs(temp, std::ios::binary);
+		if (!ofs) return;
+		ProgramBinaryHeader header = { program_binary_magic, format, (std::uint32_t)length };
+		ofs.write((char const*)&header, sizeof(header));
+		ofs.write(binary.data(), binary.size());
+		if (!ofs) return;
+	}
+	std::filesystem::rename(temp, path, ec);
+}
+
+static Shader* binded_shader = nullptr;
+
+using shader_clock = std::chrono::steady_clock;
+
+Shader::Shader(std::string const& vertex, std::string const& fragment, ShaderCompile compile)
+{
+	auto start = shader_clock::now();
 	shaderid = glCreateProgram();
+	stages = { 0, 0 };
+	pending = false;
+	uniform_count = 0;
 	destruct_this = true;
 	good = true;
-	unsigned int vshader = create_shader(GL_VERTEX_SHADER, vertex, good, err_message);
-	unsigned int fshader = create_shader(GL_FRAGMENT_SHADER, fragment, good, err_message);
-	glAttachShader(shaderid, vshader);
-	glAttachShader(shaderid, fshader);
+
+	// loading a binary skips compilation, so it is never deferred
+	binary_path = program_binary_path(vertex, fragment);
+	if (!binary_path.empty())
+	{
+		bool found;
+		if (load_program_binary(shaderid, binary_path, found))
+		{
+			ResolveUniforms();
+			shader_cache_stats.hits++;
+			shader_cache_stats.load_seconds += std::chrono::duration<double>(shader_clock::now() - start).count();
+			binary_path.clear();
+			return;
+		}
+
+		// missing or refused binary, start over with a fresh program
+		if (found) shader_cache_stats.rejected++;
+		shader_cache_stats.misses++;
+		glDeleteProgram(shaderid);
+		shaderid = glCreateProgram();
+		static auto program_parameteri = (ProgramParameteriProc)GLProcAddress("glProgramParameteri");
+		program_parameteri(shaderid, gl_program_binary_retrievable_hint, GL_TRUE);
+	}
+
+	// link right after compiling, the status of neither is queried until Finish()
+	if (compile == ShaderCompile::Async) parallel_compile_supported();
+	stages[0] = create_shader(GL_VERTEX_SHADER, vertex);
+	stages[1] = create_shader(GL_FRAGMENT_SHADER, fragment);
+	glAttachShader(shaderid, stages[0]);
+	glAttachShader(shaderid, stages[1]);
 	glLinkProgram(shaderid);
-	glDeleteShader(vshader);
-	glDeleteShader(fshader);
+	pending = true;
+	shader_cache_stats.compile_seconds += std::chrono::duration<double>(shader_clock::now() - start).count();
+	if (compile == ShaderCompile::Blocking) Finish();
+}
+
+void Shader::Finish() const
+{
+	auto start = shader_clock::now();
+	pending = false;
+	check_shader(stages[0], GL_VERTEX_SHADER, good, err_message);
+	check_shader(stages[1], GL_FRAGMENT_SHADER, good, err_message);
+	glDeleteShader(stages[0]);
+	glDeleteShader(stages[1]);
+	stages = { 0, 0 };
+	ResolveUniforms();
+	if (good && !binary_path.empty())
+		save_program_binary(shaderid, binary_path);
+	binary_path.clear();
+	shader_cache_stats.compile_seconds += std::chrono::duration<double>(shader_clock::now() - start).count();
+}
+
+bool Shader::Ready() const
+{
+	if (!pending) return true;
+	if (parallel_compile_supported())
+	{
+		int done;
+		glGetProgramiv(shaderid, gl_completion_status, &done);
+		if (!done) return false;
+	}
+	Finish();
+	return true;
 }
 
 Shader::Shader(Shader&& shader) noexcept
-	: good(shader.good), shaderid(shader.shaderid), uniform_location_cache(shader.uniform_location_cache), destruct_this(true)
+	: good(shader.good), shaderid(shader.shaderid), stages(shader.stages), binary_path(std::move(shader.binary_path)), pending(shader.pending),
+	uniform_location_cache(std::move(shader.uniform_location_cache)), uniform_count(shader.uniform_count),
+	uniform_values(std::move(shader.uniform_values)), destruct_this(true), err_message(std::move(shader.err_message))
 {
 	shader.destruct_this = false;
+	if (binded_shader == &shader) binded_shader = this;
 }
 
 static void ReadFile(std::string const& file, std::string& output)
 {
-	std::ifstream ifs(file);
+	std::ifstream ifs(file, std::ios::binary | std::ios::ate);
 	MATHYW_ASSERT(ifs.is_open(), "Cannot open file \"" + file + "\"");
-	std::string line;
-	while (getline(ifs, line))
-		output += line + '\n';
+	output.resize((std::size_t)ifs.tellg());
+	ifs.seekg(0);
+	ifs.read(output.data(), output.size());
 }
 
-Shader ReadShaderFile(std::string const& vertex, std::string const& fragment)
+Shader ReadShaderFile(std::string const& vertex, std::string const& fragment, ShaderCompile compile)
 {
 	std::string vsrc, fsrc;
 	ReadFile(vertex, vsrc), ReadFile(fragment, fsrc);
-	return Shader(vsrc, fsrc);
+	return Shader(vsrc, fsrc, compile);
 }
 
 Shader::~Shader()
 {
-	if (destruct_this)
-		glDeleteProgram(shaderid);
+	if (!destruct_this) return;
+	if (binded_shader == this) binded_shader = nullptr;
+	if (pending)
+	{
+		glDeleteShader(stages[0]);
+		glDeleteShader(stages[1]);
+	}
+	glDeleteProgram(shaderid);
+	GLStateCache::Current().ProgramDeleted(shaderid);
 }
 
-static Shader* binded_shader = nullptr;
-
 void Shader::Bind(Shader* shader)
 {
-	if (shader == binded_shader) return;
+	if (shader) shader->Wait();
 	binded_shader = shader;
-	if (shader) glUseProgram(shader->shaderid);
-	else glUseProgram(0);
+	GLStateCache::Current().UseProgram(shader ? shader->shaderid : 0);
 }
 
 Shader* Shader::Current()
@@ -87,8 +278,8 @@ void Shader::Bind()
 	Bind(this);
 }
 
-#define MATHYW_UNIFORM_VECTOR_FUNCTION(ty, sz, fn) template<> void Shader::Uniform(std::string const& name, Vector<ty, sz> const& vec)\
-	{ Bind(); int location = UniformLocation(name); fn(location, 1, &vec[0]); }
+#define MATHYW_UNIFORM_VECTOR_FUNCTION(ty, sz, fn) template<> void Shader::Uniform(UniformId name, Vector<ty, sz> const& vec)\
+	{ Bind(); int location = UniformLocation(name); if (UniformUnchanged(location, &vec[0], sizeof(vec))) return; fn(location, 1, &vec[0]); }
 
 MATHYW_UNIFORM_VECTOR_FUNCTION(int, 1, glUniform1iv)
 MATHYW_UNIFORM_VECTOR_FUNCTION(int, 2, glUniform2iv)
@@ -105,8 +296,8 @@ MATHYW_UNIFORM_VECTOR_FUNCTION(float, 2, glUniform2fv)
 MATHYW_UNIFORM_VECTOR_FUNCTION(float, 3, glUniform3fv)
 MATHYW_UNIFORM_VECTOR_FUNCTION(float, 4, glUniform4fv)
 
-#define MATHYW_UNIFORM_MATRIX_FUNCTION(r, c, fn) template<> void Shader::Uniform(std::string const& name, Matrix<float, r, c> const& mat)\
-	{ Bind(); int location = UniformLocation(name); fn(location, 1, true, &mat[0]); }
+#define MATHYW_UNIFORM_MATRIX_FUNCTION(r, c, fn) template<> void Shader::Uniform(UniformId name, Matrix<float, r, c> const& mat)\
+	{ Bind(); int location = UniformLocation(name); if (UniformUnchanged(location, &mat[0], sizeof(mat))) return; fn(location, 1, true, &mat[0]); }
 
 MATHYW_UNIFORM_MATRIX_FUNCTION(2, 2, glUniformMatrix2fv)
 MATHYW_UNIFORM_MATRIX_FUNCTION(2, 3, glUniformMatrix2x3fv)
@@ -120,15 +311,112 @@ MATHYW_UNIFORM_MATRIX_FUNCTION(4, 2, glUniformMatrix4x2fv)
 MATHYW_UNIFORM_MATRIX_FUNCTION(4, 3, glUniformMatrix4x3fv)
 MATHYW_UNIFORM_MATRIX_FUNCTION(4, 4, glUniformMatrix4fv)
 
-int Shader::UniformLocation(std::string const& name)
+void Shader::CacheUniformLocation(std::uint64_t hash, int location) const
+{
+	// keep the table at most half full so probes stay short
+	if ((uniform_count + 1) * 2 > uniform_location_cache.size())
+	{
+		auto old = std::move(uniform_location_cache);
+		uniform_location_cache.assign(std::max<std::size_t>(16, old.size() * 2), UniformSlot{ 0, -1 });
+		uniform_count = 0;
+		for (auto const& slot : old)
+			if (slot.hash) CacheUniformLocation(slot.hash, slot.location);
+	}
+
+	std::size_t mask = uniform_location_cache.size() - 1;
+	for (std::size_t i = hash & mask;; i = (i + 1) & mask)
+	{
+		auto& slot = uniform_location_cache[i];
+		if (slot.hash == hash)
+		{
+			slot.location = location;
+			return;
+		}
+		if (!slot.hash)
+		{
+			slot = UniformSlot{ hash, location };
+			uniform_count++;
+			return;
+		}
+	}
+}
+
+int Shader::UniformLocation(UniformId name)
 {
-	if (uniform_location_cache.count(name))
-		return uniform_location_cache[name];
-	int location = glGetUniformLocation(shaderid, name.c_str());
-	uniform_location_cache[name] = location;
+	Wait();
+	std::uint64_t hash = name.hash ? name.hash : 1; // zero marks an empty slot
+	if (!uniform_location_cache.empty())
+	{
+		std::size_t mask = uniform_location_cache.size() - 1;
+		for (std::size_t i = hash & mask; uniform_location_cache[i].hash; i = (i + 1) & mask)
+			if (uniform_location_cache[i].hash == hash)
+				return uniform_location_cache[i].location;
+	}
+
+	// not an active uniform, ask the driver once and remember the answer
+	int location = glGetUniformLocation(shaderid, std::string(name.name).c_str());
+	CacheUniformLocation(hash, location);
 	return location;
 }
 
+void Shader::ResolveUniforms() const
+{
+	int status;
+	glGetProgramiv(shaderid, GL_LINK_STATUS, &status);
+	if (!status)
+	{
+		if (good)
+		{
+			std::string buffer;
+			buffer.resize(512);
+			glGetProgramInfoLog(shaderid, 512, NULL, &buffer[0]);
+			err_message += "Following error found in linking:\n" + buffer;
+		}
+		good = false;
+		return;
+	}
+
+	int count, max_length;
+	glGetProgramiv(shaderid, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(shaderid, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+	std::string name(max_length, '\0');
+	for (int i = 0; i < count; i++)
+	{
+		GLsizei length;
+		GLint size;
+		GLenum type;
+		glGetActiveUniform(shaderid, i, max_length, &length, &size, &type, &name[0]);
+		int location = glGetUniformLocation(shaderid, name.c_str());
+		if (location < 0) continue; // members of uniform blocks have no location
+		std::string_view view(name.data(), length);
+		CacheUniformLocation(HashString(view), location);
+		// arrays are reported as "name[0]", the plain name refers to the same location
+		if (view.ends_with("[0]"))
+			CacheUniformLocation(HashString(view.substr(0, length - 3)), location);
+	}
+}
+
+bool Shader::UniformUnchanged(int location, void const* value, std::size_t size)
+{
+	if (location < 0) return true; // setting an inactive uniform does nothing
+	if (location >= (int)uniform_values.size())
+		uniform_values.resize(location + 1, UniformValue{ {}, 0 });
+	auto& cached = uniform_values[location];
+	if (cached.size == size && !std::memcmp(cached.data.data(), value, size))
+		return true;
+	std::memcpy(cached.data.data(), value, size);
+	cached.size = (std::uint8_t)size;
+	return false;
+}
+
+void Shader::UniformBlock(std::string_view name, std::uint32_t binding)
+{
+	Wait();
+	unsigned index = glGetUniformBlockIndex(shaderid, std::string(name).c_str());
+	MATHYW_ASSERT(index != GL_INVALID_INDEX, "Uniform block not found in Shader::UniformBlock");
+	glUniformBlockBinding(shaderid, index, binding);
+}
+
 #undef MATHYW_UNIFORM_VECTOR_FUNCTION
 #undef MATHYW_UNIFORM_MATRIX_FUNCTION
 
@@ -0,0 +1,160 @@
+#include <Mathyw/shader_variants.hpp>
+#include <fstream>
+#include <filesystem>
+#include <unordered_set>
+#include <algorithm>
+#include <cctype>
+
+namespace Mathyw {
+
+static std::string read_file(std::string const& file)
+{
+	std::ifstream ifs(file, std::ios::binary | std::ios::ate);
+	MATHYW_ASSERT(ifs.is_open(), "Cannot open file \"" + file + "\"");
+	std::string output((std::size_t)ifs.tellg(), '\0');
+	ifs.seekg(0);
+	ifs.read(output.data(), output.size());
+	return output;
+}
+
+// Returns the path of an #include directive, empty if the line is not one
+static std::string_view include_path(std::string_view line)
+{
+	auto skip_spaces = [&] { line.remove_prefix(std::min(line.find_first_not_of(" \t"), line.size())); };
+	skip_spaces();
+	if (!line.starts_with('#')) return {};
+	line.remove_prefix(1);
+	skip_spaces();
+	if (!line.starts_with("include")) return {};
+	auto open = line.find_first_of("\"<");
+	if (open == line.npos) return {};
+	auto close = line.find(line[open] == '"' ? '"' : '>', open + 1);
+	if (close == line.npos) return {};
+	return line.substr(open + 1, close - open - 1);
+}
+
+// Append the source to the output with its includes expanded
+// @param number: the line number of the first line of the source
+// @param files: contents of the files read so far, included files are read once and kept
+static void expand_includes(std::string_view source, std::size_t number, std::filesystem::path const& directory,
+	std::unordered_set<std::string>& included, std::unordered_map<std::string, std::string>& files, std::string& output)
+{
+	for (std::size_t begin = 0; begin < source.size(); number++)
+	{
+		auto end = std::min(source.find('\n', begin), source.size());
+		std::string_view line(source.data() + begin, end - begin);
+		begin = end + 1;
+		auto path = include_path(line);
+		if (path.empty())
+		{
+			output.append(line) += '\n';
+			continue;
+		}
+
+		auto file = std::filesystem::weakly_canonical(directory / path).string();
+		if (included.insert(file).second)
+		{
+			auto it = files.find(file);
+			if (it == files.end()) it = files.emplace(file, read_file(file)).first;
+			output += "#line 1\n";
+			expand_includes(it->second, 1, std::filesystem::path(file).parent_path(), included, files, output);
+		}
+		output += "#line " + std::to_string(number + 1) + '\n';
+	}
+}
+
+// Preprocess a source, reading the included files through the cache
+static std::string preprocess(std::string const& source, std::string const& directory, std::span<ShaderDefine const> defines,
+	std::unordered_map<std::string, std::string>& files)
+{
+	std::string output;
+	output.reserve(source.size());
+	std::string_view rest = source;
+
+	// #version must stay the first directive, the defines follow it
+	auto version = source.find("#version");
+	std::size_t body_line = 1;
+	if (version != source.npos && source.find_first_not_of(" \t\r\n") == version)
+	{
+		auto end = std::min(source.find('\n', version), source.size());
+		output.append(source, 0, end) += '\n';
+		rest = std::string_view(source).substr(std::min(end + 1, source.size()));
+		body_line += std::count(source.begin(), source.begin() + end, '\n') + 1;
+	}
+	for (auto const& define : defines)
+		output += "#define " + define.name + ' ' + define.value + '\n';
+	if (!defines.empty() || body_line > 1)
+		output += "#line " + std::to_string(body_line) + '\n';
+
+	std::unordered_set<std::string> included;
+	expand_includes(rest, body_line, directory.empty() ? "." : directory, included, files, output);
+	return output;
+}
+
+// Returns true if the name appears in the source as a whole identifier
+static bool uses_identifier(std::string_view source, std::string_view name)
+{
+	auto is_identifier = [](char c) { return std::isalnum((unsigned char)c) || c == '_'; };
+	for (auto pos = source.find(name); pos != source.npos; pos = source.find(name, pos + 1))
+	{
+		auto end = pos + name.size();
+		if ((pos == 0 || !is_identifier(source[pos - 1])) && (end == source.size() || !is_identifier(source[end])))
+			return true;
+	}
+	return false;
+}
+
+std::string PreprocessShader(std::string const& source, std::string const& directory, std::span<ShaderDefine const> defines)
+{
+	std::unordered_map<std::string, std::string> files;
+	return preprocess(source, directory, defines, files);
+}
+
+std::string PreprocessShaderFile(std::string const& file, std::span<ShaderDefine const> defines)
+{
+	return PreprocessShader(read_file(file), std::filesystem::path(file).parent_path().string(), defines);
+}
+
+ShaderVariants::ShaderVariants(ShaderCompile compile)
+	: compile(compile)
+{
+}
+
+Shader& ShaderVariants::Get(std::string const& vertex, std::string const& fragment, std::span<ShaderDefine const> defines)
+{
+	std::vector<ShaderDefine> sorted(defines.begin(), defines.end());
+	std::sort(sorted.begin(), sorted.end(), [](auto const& a, auto const& b) { return a.name < b.name; });
+	std::string key = vertex + '\0' + fragment;
+	for (auto const& define : sorted)
+		key += '\0' + define.name + '=' + define.value;
+	if (auto it = variants.find(key); it != variants.end())
+		return *it->second;
+
+	// expand each stage with only the defines its code refers to,
+	// so permutations differing by defines that change nothing share the program
+	auto expand = [&](std::string const& file) {
+		auto it = files.find(file);
+		if (it == files.end()) it = files.emplace(file, read_file(file)).first;
+		auto const& source = it->second; // stays valid while includes are added to the map
+		auto directory = std::filesystem::path(file).parent_path().string();
+		auto plain = preprocess(source, directory, {}, files);
+		std::vector<ShaderDefine> used;
+		for (auto const& define : sorted)
+			if (uses_identifier(plain, define.name)) used.push_back(define);
+		return used.empty() ? plain : preprocess(source, directory, used, files);
+	};
+	std::string vsrc = expand(vertex), fsrc = expand(fragment);
+	auto& program = programs[vsrc + '\0' + fsrc];
+	if (!program) program = std::make_unique<Shader>(vsrc, fsrc, compile);
+	variants.emplace(std::move(key), program.get());
+	return *program;
+}
+
+void ShaderVariants::Clear()
+{
+	variants.clear();
+	programs.clear();
+	files.clear();
+}
+
+} // !Mathyw
@@ -0,0 +1,274 @@
+#include <Mathyw/state_cache.hpp>
+#include <mutex>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+namespace Mathyw {
+
+// OpenGL 4.3 buffer targets, not provided by the 3.3 loader
+static constexpr GLenum gl_draw_indirect_buffer = 0x8F3F;
+static constexpr GLenum gl_shader_storage_buffer = 0x90D2;
+
+// Slot of a buffer target in the cache, -1 if it is not cached
+static constexpr int buffer_slot(std::uint32_t target)
+{
+	switch (target)
+	{
+	case GL_ARRAY_BUFFER: return 0;
+	case GL_ELEMENT_ARRAY_BUFFER: return 1;
+	case GL_COPY_READ_BUFFER: return 2;
+	case GL_COPY_WRITE_BUFFER: return 3;
+	case GL_PIXEL_PACK_BUFFER: return 4;
+	case GL_PIXEL_UNPACK_BUFFER: return 5;
+	case GL_UNIFORM_BUFFER: return 6;
+	case gl_draw_indirect_buffer: return 7;
+	case gl_shader_storage_buffer: return 8;
+	default: return -1;
+	}
+}
+
+// Slot of an indexed buffer target in the cache, -1 if it is not cached
+static constexpr int indexed_slot(std::uint32_t target)
+{
+	switch (target)
+	{
+	case GL_UNIFORM_BUFFER: return 0;
+	case gl_shader_storage_buffer: return 1;
+	default: return -1;
+	}
+}
+
+// Bit of a capability in the cache, zero if it is not cached
+static constexpr std::uint32_t capability_bit(std::uint32_t cap)
+{
+	switch (cap)
+	{
+	case GL_BLEND: return 1 << 0;
+	case GL_DEPTH_TEST: return 1 << 1;
+	case GL_CULL_FACE: return 1 << 2;
+	case GL_STENCIL_TEST: return 1 << 3;
+	case GL_SCISSOR_TEST: return 1 << 4;
+	case GL_MULTISAMPLE: return 1 << 5;
+	case GL_FRAMEBUFFER_SRGB: return 1 << 6;
+	case GL_PROGRAM_POINT_SIZE: return 1 << 7;
+	default: return 0;
+	}
+}
+
+GLStateCache::GLStateCache()
+	: program(0), vao(0), draw_framebuffer(0), read_framebuffer(0), active_unit(0), enabled(capability_bit(GL_MULTISAMPLE)), known(0xFF),
+	blend_src(GL_ONE), blend_dst(GL_ZERO), viewport(-1), scissor(-1)
+{
+	buffers.fill(0);
+	for (auto& targets : indexed)
+		targets.fill(IndexedBinding{ 0, 0, 0 });
+	textures.fill(0);
+}
+
+static std::mutex caches_mutex;
+static std::unordered_map<void*, GLStateCache> caches;
+static thread_local GLStateCache* current_cache = nullptr;
+
+GLStateCache& GLStateCache::Current()
+{
+	if (!current_cache) MakeCurrent(glfwGetCurrentContext());
+	return *current_cache;
+}
+
+void GLStateCache::MakeCurrent(void* context)
+{
+	std::lock_guard lock(caches_mutex);
+	current_cache = &caches[context];
+}
+
+void GLStateCache::Destroy(void* context)
+{
+	std::lock_guard lock(caches_mutex);
+	auto it = caches.find(context);
+	if (it == caches.end()) return;
+	if (current_cache == &it->second) current_cache = nullptr;
+	caches.erase(it);
+}
+
+void GLStateCache::Invalidate()
+{
+	program = vao = unknown;
+	draw_framebuffer = read_framebuffer = unknown;
+	buffers.fill(unknown);
+	for (auto& targets : indexed)
+		targets.fill(IndexedBinding{ unknown, 0, 0 });
+	active_unit = -1;
+	textures.fill(unknown);
+	known = 0;
+	blend_src = blend_dst = unknown;
+	viewport = scissor = Ivec4(-1);
+}
+
+void GLStateCache::UseProgram(std::uint32_t program)
+{
+	if (!Cached(this->program, program))
+		glUseProgram(program);
+}
+
+void GLStateCache::BindVertexArray(std::uint32_t vao)
+{
+	if (Cached(this->vao, vao)) return;
+	glBindVertexArray(vao);
+	buffers[buffer_slot(GL_ELEMENT_ARRAY_BUFFER)] = unknown;
+}
+
+void GLStateCache::BindBuffer(std::uint32_t target, std::uint32_t buffer)
+{
+	int slot = buffer_slot(target);
+	if (slot < 0) stats.issued++;
+	else if (Cached(buffers[slot], buffer)) return;
+	glBindBuffer(target, buffer);
+}
+
+void GLStateCache::BindBufferBase(std::uint32_t target, std::uint32_t index, std::uint32_t buffer)
+{
+	BindBufferRange(target, index, buffer, 0, 0);
+}
+
+void GLStateCache::BindBufferRange(std::uint32_t target, std::uint32_t index, std::uint32_t buffer, std::size_t offset, std::size_t size)
+{
+	int slot = indexed_slot(target);
+	if (slot >= 0 && index < indexed_bindings)
+	{
+		auto& binding = indexed[slot][index];
+		if (binding.buffer == buffer && binding.offset == offset && binding.size == size)
+		{
+			stats.skipped++;
+			return;
+		}
+		binding = IndexedBinding{ buffer, offset, size };
+	}
+	stats.issued++;
+	if (size) glBindBufferRange(target, index, buffer, offset, size);
+	else glBindBufferBase(target, index, buffer);
+	if (int generic = buffer_slot(target); generic >= 0)
+		buffers[generic] = buffer;
+}
+
+void GLStateCache::BindFramebuffer(std::uint32_t target, std::uint32_t framebuffer)
+{
+	if (target == GL_FRAMEBUFFER)
+	{
+		if (draw_framebuffer == framebuffer && read_framebuffer == framebuffer)
+		{
+			stats.skipped++;
+			return;
+		}
+		stats.issued++;
+		draw_framebuffer = read_framebuffer = framebuffer;
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		return;
+	}
+	auto& slot = target == GL_DRAW_FRAMEBUFFER ? draw_framebuffer : read_framebuffer;
+	if (!Cached(slot, framebuffer))
+		glBindFramebuffer(target, framebuffer);
+}
+
+void GLStateCache::ActiveTexture(int unit)
+{
+	if (!Cached(active_unit, unit))
+		glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLStateCache::BindTexture(int unit, std::uint32_t target, std::uint32_t texture)
+{
+	if (target == GL_TEXTURE_2D && unit < texture_units && textures[unit] == texture)
+	{
+		stats.skipped++;
+		return;
+	}
+	ActiveTexture(unit);
+	BindTexture(target, texture);
+}
+
+void GLStateCache::BindTexture(std::uint32_t target, std::uint32_t texture)
+{
+	if (target != GL_TEXTURE_2D || active_unit < 0 || active_unit >= texture_units) stats.issued++;
+	else if (Cached(textures[active_unit], texture)) return;
+	glBindTexture(target, texture);
+}
+
+void GLStateCache::Capability(std::uint32_t cap, bool enable)
+{
+	std::uint32_t bit = capability_bit(cap);
+	if ((known & bit) && bool(enabled & bit) == enable)
+	{
+		stats.skipped++;
+		return;
+	}
+	stats.issued++;
+	known |= bit;
+	if (enable) enabled |= bit, glEnable(cap);
+	else enabled &= ~bit, glDisable(cap);
+}
+
+bool GLStateCache::IsEnabled(std::uint32_t cap) const
+{
+	std::uint32_t bit = capability_bit(cap);
+	if (bit && (known & bit)) return enabled & bit;
+	return glIsEnabled(cap);
+}
+
+void GLStateCache::BlendFunc(std::uint32_t src, std::uint32_t dst)
+{
+	if (blend_src == src && blend_dst == dst)
+	{
+		stats.skipped++;
+		return;
+	}
+	stats.issued++;
+	blend_src = src, blend_dst = dst;
+	glBlendFunc(src, dst);
+}
+
+void GLStateCache::Viewport(Ivec4 viewport)
+{
+	if (!Cached(this->viewport, viewport))
+		glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void GLStateCache::Scissor(Ivec4 box)
+{
+	if (!Cached(scissor, box))
+		glScissor(box[0], box[1], box[2], box[3]);
+}
+
+void GLStateCache::ProgramDeleted(std::uint32_t program)
+{
+	if (this->program == program) this->program = unknown;
+}
+
+void GLStateCache::VertexArrayDeleted(std::uint32_t vao)
+{
+	if (this->vao != vao) return;
+	this->vao = 0;
+	buffers[buffer_slot(GL_ELEMENT_ARRAY_BUFFER)] = unknown;
+}
+
+void GLStateCache::BufferDeleted(std::uint32_t buffer)
+{
+	for (auto& bound : buffers)
+		if (bound == buffer) bound = 0;
+	for (auto& targets : indexed)
+		for (auto& binding : targets)
+			if (binding.buffer == buffer) binding.buffer = 0;
+}
+
+void GLStateCache::FramebufferDeleted(std::uint32_t framebuffer)
+{
+	if (draw_framebuffer == framebuffer) draw_framebuffer = 0;
+	if (read_framebuffer == framebuffer) read_framebuffer = 0;
+}
+
+void GLStateCache::TextureDeleted(std::uint32_t texture)
+{
+	for (auto& bound : textures)
+		if (bound == texture) bound = 0;
+}
+
+} // !Mathyw
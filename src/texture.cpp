@@ -1,10 +1,21 @@
 #include <Mathyw/texture.hpp>
+#include <Mathyw/state_cache.hpp>
+#include <Mathyw/opengl.hpp>
+#include <thread>
+#include <algorithm>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <stb/stb_image.h>
 
 namespace Mathyw {
 
+// OpenGL 4.2 and anisotropic filtering enums and functions, not provided by the 3.3 loader
+static constexpr GLenum gl_texture_max_anisotropy = 0x84FE;
+static constexpr GLenum gl_max_texture_max_anisotropy = 0x84FF;
+using TexStorage2DProc = void (APIENTRYP)(GLenum, GLsizei, GLenum, GLsizei, GLsizei);
+
+static std::size_t total_bytes = 0;
+
 static constexpr int texture_format(int channels)
 {
 	switch (channels)
@@ -17,60 +28,304 @@ static constexpr int texture_format(int channels)
 	}
 }
 
-Texture::Texture(std::uint8_t const* data, Ivec2 size, int channels)
+std::uint32_t Texture::InternalFormat(TextureFormat format)
 {
-	destruct_this = true;
-	this->size = size;
-	glGenTextures(1, &textureid);
-	glBindTexture(GL_TEXTURE_2D, textureid);
+	switch (format)
+	{
+	case TextureFormat::R8: return GL_R8;
+	case TextureFormat::RG8: return GL_RG8;
+	case TextureFormat::RGB8: return GL_RGB8;
+	case TextureFormat::RGBA8: return GL_RGBA8;
+	case TextureFormat::SRGB8: return GL_SRGB8;
+	case TextureFormat::SRGB8A8: return GL_SRGB8_ALPHA8;
+	case TextureFormat::R16F: return GL_R16F;
+	default: return GL_RGBA8;
+	}
+}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size[0], size[1], 0, texture_format(channels), GL_UNSIGNED_BYTE, data);
+static constexpr std::size_t texel_size(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::R8: return 1;
+	case TextureFormat::RG8: case TextureFormat::R16F: return 2;
+	case TextureFormat::RGB8: case TextureFormat::SRGB8: return 3;
+	default: return 4;
+	}
+}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+static constexpr GLint texture_wrap(TextureWrap wrap)
+{
+	switch (wrap)
+	{
+	case TextureWrap::MirroredRepeat: return GL_MIRRORED_REPEAT;
+	case TextureWrap::ClampToEdge: return GL_CLAMP_TO_EDGE;
+	case TextureWrap::ClampToBorder: return GL_CLAMP_TO_BORDER;
+	default: return GL_REPEAT;
+	}
 }
 
-Texture::Texture(std::string const& path, int channels)
+// Wait until the GPU has finished reading the buffer of the fence
+static void wait_fence(void*& fence)
 {
-	destruct_this = true;
-	glGenTextures(1, &textureid);
-	glBindTexture(GL_TEXTURE_2D, textureid);
+	if (!fence) return;
+	GLsync sync = (GLsync)fence;
+	while (glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+	glDeleteSync(sync);
+	fence = nullptr;
+}
 
-	stbi_set_flip_vertically_on_load(true);
-	int ch;
-	stbi_uc* data = stbi_load(path.c_str(), &size[0], &size[1], &ch, channels);
+static constexpr Ivec2 level_size(Ivec2 size, int level)
+{
+	return Ivec2(std::max(1, size[0] >> level), std::max(1, size[1] >> level));
+}
+
+// Run the function on ranges of rows split among threads, small images stay on the calling thread
+static void parallel_rows(int rows, std::size_t row_size, std::function<void(int, int)> const& fn)
+{
+	int threads = std::clamp(int(rows * row_size / (256 << 10)), 1, (int)std::max(1u, std::thread::hardware_concurrency()));
+	if (threads == 1) return fn(0, rows);
+	std::vector<std::thread> workers;
+	for (int i = 1; i < threads; i++)
+		workers.emplace_back(fn, rows * i / threads, rows * (i + 1) / threads);
+	fn(0, rows / threads);
+	for (auto& worker : workers) worker.join();
+}
+
+// Average 2x2 blocks of the source into the destination, color channels of sRGB data are averaged in linear space
+static void downsample(std::uint8_t const* src, Ivec2 src_size, std::uint8_t* dst, Ivec2 dst_size, int channels, bool srgb)
+{
+	static auto const to_linear = [] {
+		std::array<float, 256> table;
+		for (int i = 0; i < 256; i++)
+		{
+			float c = i / 255.0f;
+			table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		return table;
+	}();
+	auto to_srgb = [](float c) {
+		c = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+		return std::uint8_t(std::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f);
+	};
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size[0], size[1], 0,
-		texture_format(channels == 0 || ch < channels ? ch : channels), GL_UNSIGNED_BYTE, data);
+	parallel_rows(dst_size[1], std::size_t(dst_size[0]) * channels, [&](int begin, int end) {
+		for (int y = begin; y < end; y++)
+		{
+			int y0 = std::min(y * 2, src_size[1] - 1), y1 = std::min(y * 2 + 1, src_size[1] - 1);
+			for (int x = 0; x < dst_size[0]; x++)
+			{
+				int x0 = std::min(x * 2, src_size[0] - 1), x1 = std::min(x * 2 + 1, src_size[0] - 1);
+				std::uint8_t const* texels[4] = {
+					src + (std::size_t(y0) * src_size[0] + x0) * channels, src + (std::size_t(y0) * src_size[0] + x1) * channels,
+					src + (std::size_t(y1) * src_size[0] + x0) * channels, src + (std::size_t(y1) * src_size[0] + x1) * channels
+				};
+				std::uint8_t* out = dst + (std::size_t(y) * dst_size[0] + x) * channels;
+				for (int c = 0; c < channels; c++)
+				{
+					if (srgb && c < 3)
+					{
+						float sum = 0;
+						for (auto texel : texels) sum += to_linear[texel[c]];
+						out[c] = to_srgb(sum * 0.25f);
+					}
+					else out[c] = std::uint8_t((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+				}
+			}
+		}
+	});
+}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
-	if (data) stbi_image_free(data);
+Texture::Texture(std::uint8_t const* data, Ivec2 size, int channels, TextureDesc const& desc)
+{
+	destruct_this = true;
+	this->size = size;
+	Create(channels, desc);
+	if (data) Upload(data);
+}
+
+Texture::Texture(std::string const& path, int channels, TextureDesc const& desc)
+{
+	destruct_this = true;
+	stbi_set_flip_vertically_on_load_thread(true);
+	int ch = 0;
+	stbi_uc* data = stbi_load(path.c_str(), &size[0], &size[1], &ch, channels);
+	MATHYW_ASSERT(data, "Cannot load texture \"" + path + "\"");
+	if (!data) size = Ivec2(1, 1), ch = 4;
+	Create(channels == 0 || ch < channels ? ch : channels, desc);
+	if (data)
+	{
+		Upload(data);
+		stbi_image_free(data);
+	}
 }
 
 Texture::Texture(Texture&& texture) noexcept
-	: textureid(texture.textureid), size(texture.size), destruct_this(true)
+	: textureid(texture.textureid), size(texture.size), format(texture.format), mipmaps(texture.mipmaps),
+	levels(texture.levels), channels(texture.channels), bytes(texture.bytes),
+	pbos(texture.pbos), pbo_sizes(texture.pbo_sizes), fences(texture.fences), pbo_index(texture.pbo_index), destruct_this(true)
 {
 	texture.destruct_this = false;
 }
 
 Texture::~Texture()
 {
-	if (destruct_this)
-		glDeleteTextures(1, &textureid);
+	if (!destruct_this) return;
+	total_bytes -= bytes;
+	glDeleteTextures(1, &textureid);
+	auto& state = GLStateCache::Current();
+	state.TextureDeleted(textureid);
+	for (int i = 0; i < 3; i++)
+	{
+		if (fences[i]) glDeleteSync((GLsync)fences[i]);
+		if (!pbos[i]) continue;
+		glDeleteBuffers(1, &pbos[i]);
+		state.BufferDeleted(pbos[i]);
+	}
+}
+
+void Texture::Create(int channels, TextureDesc const& desc)
+{
+	static constexpr TextureFormat auto_formats[] = { TextureFormat::R8, TextureFormat::RG8, TextureFormat::RGB8, TextureFormat::RGBA8 };
+	this->channels = channels;
+	pbos.fill(0);
+	pbo_sizes.fill(0);
+	fences.fill(nullptr);
+	pbo_index = 0;
+	format = desc.format == TextureFormat::Auto ? auto_formats[std::clamp(channels, 1, 4) - 1] : desc.format;
+	mipmaps = desc.mipmaps;
+	levels = 1;
+	if (mipmaps != MipmapMode::None)
+		while ((std::max(size[0], size[1]) >> levels) > 0) levels++;
+
+	bytes = 0;
+	for (int i = 0; i < levels; i++)
+		bytes += std::size_t(level_size(size, i)[0]) * level_size(size, i)[1] * texel_size(format);
+	total_bytes += bytes;
+
+	glGenTextures(1, &textureid);
+	GLStateCache::Current().BindTexture(GL_TEXTURE_2D, textureid);
+	static auto tex_storage = GLSupports(4, 2) || GLSupports("GL_ARB_texture_storage")
+		? (TexStorage2DProc)GLProcAddress("glTexStorage2D") : nullptr;
+	if (tex_storage) tex_storage(GL_TEXTURE_2D, levels, InternalFormat(format), size[0], size[1]);
+	else
+	{
+		for (int i = 0; i < levels; i++)
+		{
+			Ivec2 dim = level_size(size, i);
+			glTexImage2D(GL_TEXTURE_2D, i, InternalFormat(format), dim[0], dim[1], 0, texture_format(channels), GL_UNSIGNED_BYTE, nullptr);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	}
+	SetSampler(desc.sampler);
+}
+
+void Texture::Upload(std::uint8_t const* data)
+{
+	GLStateCache::Current().BindTexture(GL_TEXTURE_2D, textureid);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size[0], size[1], texture_format(channels), GL_UNSIGNED_BYTE, data);
+	GenerateMipmaps(data);
+}
+
+void Texture::GenerateMipmaps(std::uint8_t const* data)
+{
+	if (levels == 1) return;
+	GLStateCache::Current().BindTexture(GL_TEXTURE_2D, textureid);
+	if (mipmaps == MipmapMode::GPU || !data)
+	{
+		glGenerateMipmap(GL_TEXTURE_2D);
+		return;
+	}
+
+	bool srgb = format == TextureFormat::SRGB8 || format == TextureFormat::SRGB8A8;
+	std::vector<std::uint8_t> previous, current;
+	std::uint8_t const* src = data;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = 1; i < levels; i++)
+	{
+		Ivec2 src_size = level_size(size, i - 1), dst_size = level_size(size, i);
+		current.resize(std::size_t(dst_size[0]) * dst_size[1] * channels);
+		downsample(src, src_size, current.data(), dst_size, channels, srgb);
+		glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, dst_size[0], dst_size[1], texture_format(channels), GL_UNSIGNED_BYTE, current.data());
+		std::swap(previous, current);
+		src = previous.data();
+	}
+}
+
+void Texture::SetSampler(TextureSampler const& sampler)
+{
+	static constexpr GLint min_filters[2][2] = {
+		{ GL_NEAREST_MIPMAP_NEAREST, GL_NEAREST_MIPMAP_LINEAR },
+		{ GL_LINEAR_MIPMAP_NEAREST, GL_LINEAR_MIPMAP_LINEAR }
+	};
+	bool min_linear = sampler.min_filter == TextureFilter::Linear;
+	GLint min_filter = levels == 1 ? (min_linear ? GL_LINEAR : GL_NEAREST)
+		: min_filters[min_linear][sampler.mip_filter == TextureFilter::Linear];
+
+	GLStateCache::Current().BindTexture(GL_TEXTURE_2D, textureid);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampler.mag_filter == TextureFilter::Linear ? GL_LINEAR : GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, texture_wrap(sampler.wrap_s));
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, texture_wrap(sampler.wrap_t));
+
+	static bool anisotropic = GLSupports(4, 6) || GLSupports("GL_EXT_texture_filter_anisotropic") || GLSupports("GL_ARB_texture_filter_anisotropic");
+	if (anisotropic)
+	{
+		float max_anisotropy;
+		glGetFloatv(gl_max_texture_max_anisotropy, &max_anisotropy);
+		glTexParameterf(GL_TEXTURE_2D, gl_texture_max_anisotropy, std::min(sampler.anisotropy, max_anisotropy));
+	}
+}
+
+void Texture::Update(Ivec4 region, std::uint8_t const* data, std::size_t row_pitch, int level)
+{
+	MATHYW_ASSERT(level < levels && region[0] >= 0 && region[1] >= 0 && region[0] + region[2] <= level_size(size, level)[0]
+		&& region[1] + region[3] <= level_size(size, level)[1], "Texture::Update region out of bounds");
+	if (region[2] <= 0 || region[3] <= 0) return;
+	std::size_t row_size = std::size_t(region[2]) * channels;
+	if (!row_pitch) row_pitch = row_size;
+
+	// the pitch is passed to OpenGL as a row length if it is a whole number of pixels, otherwise rows are repacked
+	bool strided = row_pitch % channels == 0;
+	std::size_t buffer_size = strided ? row_pitch * (region[3] - 1) + row_size : row_size * region[3];
+
+	auto& state = GLStateCache::Current();
+	auto& pbo = pbos[pbo_index];
+	if (!pbo) glGenBuffers(1, &pbo);
+	wait_fence(fences[pbo_index]);
+	state.BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	if (pbo_sizes[pbo_index] < buffer_size)
+	{
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, buffer_size, nullptr, GL_STREAM_DRAW);
+		pbo_sizes[pbo_index] = buffer_size;
+	}
+	auto* dst = (std::uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, buffer_size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (strided) std::memcpy(dst, data, buffer_size);
+	else for (int y = 0; y < region[3]; y++)
+		std::memcpy(dst + y * row_size, data + y * row_pitch, row_size);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	state.BindTexture(GL_TEXTURE_2D, textureid);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (strided) glPixelStorei(GL_UNPACK_ROW_LENGTH, int(row_pitch / channels));
+	glTexSubImage2D(GL_TEXTURE_2D, level, region[0], region[1], region[2], region[3], texture_format(channels), GL_UNSIGNED_BYTE, nullptr);
+	if (strided) glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	fences[pbo_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	pbo_index = (pbo_index + 1) % 3;
+	// uploads of other textures read from client memory, never from the pixel buffer
+	state.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+std::size_t Texture::TotalByteSize()
+{
+	return total_bytes;
 }
 
 void Texture::Bind(Texture* texture, int slot)
 {
-	glActiveTexture(GL_TEXTURE0 + slot);
-	if (texture) glBindTexture(GL_TEXTURE_2D, texture->textureid);
-	else glBindTexture(GL_TEXTURE_2D, 0);
+	GLStateCache::Current().BindTexture(slot, GL_TEXTURE_2D, texture ? texture->textureid : 0);
 }
 
 void Texture::Bind(int slot)
@@ -78,4 +333,4 @@ void Texture::Bind(int slot)
 	Bind(this, slot);
 }
 
-}
\ No newline at end of file
+}
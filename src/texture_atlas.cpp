@@ -0,0 +1,218 @@
+#include <Mathyw/texture_atlas.hpp>
+#include <chrono>
+#include <algorithm>
+#include <stb/stb_image.h>
+
+namespace Mathyw {
+
+static bool rect_contains(Ivec4 a, Ivec4 b)
+{
+	return b[0] >= a[0] && b[1] >= a[1] && b[0] + b[2] <= a[0] + a[2] && b[1] + b[3] <= a[1] + a[3];
+}
+
+static bool rect_intersects(Ivec4 a, Ivec4 b)
+{
+	return a[0] < b[0] + b[2] && b[0] < a[0] + a[2] && a[1] < b[1] + b[3] && b[1] < a[1] + a[3];
+}
+
+// Returns the free rectangle that fits the size with the smallest leftover side, w and h are zero if none fits
+static Ivec4 find_position(std::vector<Ivec4> const& free_rects, Ivec2 size, Ivec2& score)
+{
+	Ivec4 best(0);
+	score = Ivec2(INT32_MAX, INT32_MAX);
+	for (auto const& free : free_rects)
+	{
+		if (free[2] < size[0] || free[3] < size[1]) continue;
+		int dx = free[2] - size[0], dy = free[3] - size[1];
+		Ivec2 fit(std::min(dx, dy), std::max(dx, dy));
+		if (fit[0] < score[0] || (fit[0] == score[0] && fit[1] < score[1]))
+			best = Ivec4(free[0], free[1], size[0], size[1]), score = fit;
+	}
+	return best;
+}
+
+// Split every free rectangle overlapped by the placed one, then drop rectangles inside others
+static void split_free_rects(std::vector<Ivec4>& free_rects, Ivec4 used)
+{
+	std::vector<Ivec4> result;
+	result.reserve(free_rects.size() + 4);
+	for (auto const& free : free_rects)
+	{
+		if (!rect_intersects(free, used))
+		{
+			result.push_back(free);
+			continue;
+		}
+		if (used[0] > free[0]) result.emplace_back(free[0], free[1], used[0] - free[0], free[3]);
+		if (used[0] + used[2] < free[0] + free[2])
+			result.emplace_back(used[0] + used[2], free[1], free[0] + free[2] - used[0] - used[2], free[3]);
+		if (used[1] > free[1]) result.emplace_back(free[0], free[1], free[2], used[1] - free[1]);
+		if (used[1] + used[3] < free[1] + free[3])
+			result.emplace_back(free[0], used[1] + used[3], free[2], free[1] + free[3] - used[1] - used[3]);
+	}
+
+	for (std::size_t i = 0; i < result.size(); i++)
+		for (std::size_t j = 0; j < result.size(); j++)
+		{
+			if (i == j || !rect_contains(result[j], result[i])) continue;
+			// identical rectangles, keep the first one only
+			if (rect_contains(result[i], result[j]) && i < j) continue;
+			result.erase(result.begin() + i--);
+			break;
+		}
+	free_rects = std::move(result);
+}
+
+TextureAtlas::TextureAtlas(Ivec2 page_size, int channels, int padding, TextureDesc const& desc)
+	: page_size(page_size), channels(channels), padding(padding), desc(desc), pack_seconds(0.0)
+{
+	this->desc.mipmaps = MipmapMode::None;
+}
+
+AtlasImage TextureAtlas::Insert(std::uint8_t const* data, Ivec2 size, std::size_t row_pitch)
+{
+	if (size[0] <= 0 || size[1] <= 0) return AtlasImage();
+	if (size[0] + padding * 2 > page_size[0] || size[1] + padding * 2 > page_size[1]) return AtlasImage();
+	std::size_t row_size = std::size_t(size[0]) * channels;
+	if (!row_pitch) row_pitch = row_size;
+
+	Entry entry{ AtlasRegion{ 0, Ivec4(0, 0, size[0], size[1]), Fvec4(0) }, {}, true };
+	entry.pixels.resize(row_size * size[1]);
+	for (int y = 0; y < size[1]; y++)
+		std::memcpy(entry.pixels.data() + y * row_size, data + y * row_pitch, row_size);
+	Place(entry);
+
+	AtlasImage image;
+	if (free_ids.empty())
+	{
+		image.id = (std::uint32_t)entries.size();
+		entries.push_back(std::move(entry));
+	}
+	else
+	{
+		image.id = free_ids.back();
+		free_ids.pop_back();
+		entries[image.id] = std::move(entry);
+	}
+	return image;
+}
+
+AtlasImage TextureAtlas::Insert(std::string const& path)
+{
+	stbi_set_flip_vertically_on_load_thread(true);
+	Ivec2 size;
+	int ch;
+	stbi_uc* data = stbi_load(path.c_str(), &size[0], &size[1], &ch, channels);
+	MATHYW_ASSERT(data, "Cannot load texture \"" + path + "\"");
+	if (!data) return AtlasImage();
+	AtlasImage image = Insert(data, size);
+	stbi_image_free(data);
+	return image;
+}
+
+void TextureAtlas::Remove(AtlasImage image)
+{
+	MATHYW_ASSERT(image && image.id < entries.size() && entries[image.id].alive, "Invalid image handle in TextureAtlas");
+	auto& entry = entries[image.id];
+	Ivec4 rect = entry.region.rect;
+	pages[entry.region.page].free_rects.emplace_back(rect[0] - padding, rect[1] - padding, rect[2] + padding * 2, rect[3] + padding * 2);
+	entry.alive = false;
+	entry.pixels = {};
+	free_ids.push_back(image.id);
+}
+
+AtlasRegion const& TextureAtlas::Region(AtlasImage image) const
+{
+	MATHYW_ASSERT(image && image.id < entries.size() && entries[image.id].alive, "Invalid image handle in TextureAtlas");
+	return entries[image.id].region;
+}
+
+void TextureAtlas::Place(Entry& entry)
+{
+	auto start = std::chrono::steady_clock::now();
+	Ivec2 padded(entry.region.rect[2] + padding * 2, entry.region.rect[3] + padding * 2);
+	int best_page = -1;
+	Ivec4 best_rect;
+	Ivec2 best_score(INT32_MAX, INT32_MAX);
+	for (int i = 0; i < (int)pages.size(); i++)
+	{
+		Ivec2 score;
+		Ivec4 rect = find_position(pages[i].free_rects, padded, score);
+		if (rect[2] && (score[0] < best_score[0] || (score[0] == best_score[0] && score[1] < best_score[1])))
+			best_page = i, best_rect = rect, best_score = score;
+	}
+	if (best_page < 0)
+	{
+		best_page = (int)pages.size();
+		pages.push_back(AtlasPage{ Texture(nullptr, page_size, channels, desc), { Ivec4(0, 0, page_size[0], page_size[1]) } });
+		best_rect = Ivec4(0, 0, padded[0], padded[1]);
+	}
+	split_free_rects(pages[best_page].free_rects, best_rect);
+	pack_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	Ivec4 rect(best_rect[0] + padding, best_rect[1] + padding, entry.region.rect[2], entry.region.rect[3]);
+	entry.region.page = best_page;
+	entry.region.rect = rect;
+	entry.region.uv = Fvec4(float(rect[0]) / page_size[0], float(rect[1]) / page_size[1],
+		float(rect[0] + rect[2]) / page_size[0], float(rect[1] + rect[3]) / page_size[1]);
+	Upload(entry);
+}
+
+void TextureAtlas::Upload(Entry const& entry)
+{
+	Ivec4 rect = entry.region.rect;
+	Ivec2 padded(rect[2] + padding * 2, rect[3] + padding * 2);
+	std::size_t row_size = std::size_t(rect[2]) * channels, padded_row = std::size_t(padded[0]) * channels;
+	std::vector<std::uint8_t> pixels(padded_row * padded[1]);
+	for (int y = 0; y < padded[1]; y++)
+	{
+		auto const* src = entry.pixels.data() + std::clamp(y - padding, 0, rect[3] - 1) * row_size;
+		auto* dst = pixels.data() + y * padded_row;
+		for (int x = 0; x < padding; x++)
+		{
+			std::memcpy(dst + x * channels, src, channels);
+			std::memcpy(dst + (padding + rect[2] + x) * channels, src + row_size - channels, channels);
+		}
+		std::memcpy(dst + padding * channels, src, row_size);
+	}
+	pages[entry.region.page].texture.Update(Ivec4(rect[0] - padding, rect[1] - padding, padded[0], padded[1]), pixels.data());
+}
+
+void TextureAtlas::Repack()
+{
+	for (auto& page : pages)
+		page.free_rects.assign(1, Ivec4(0, 0, page_size[0], page_size[1]));
+
+	std::vector<Entry*> order;
+	for (auto& entry : entries)
+		if (entry.alive) order.push_back(&entry);
+	std::sort(order.begin(), order.end(), [](Entry const* a, Entry const* b) {
+		Ivec4 ra = a->region.rect, rb = b->region.rect;
+		return std::max(ra[2], ra[3]) != std::max(rb[2], rb[3]) ? std::max(ra[2], ra[3]) > std::max(rb[2], rb[3])
+			: ra[2] * ra[3] > rb[2] * rb[3];
+	});
+
+	// pages are refilled in order, so the empty ones are all at the back
+	for (auto* entry : order)
+		Place(*entry);
+	while (!pages.empty() && pages.back().free_rects.size() == 1
+		&& pages.back().free_rects[0] == Ivec4(0, 0, page_size[0], page_size[1]))
+		pages.pop_back();
+}
+
+TextureAtlasStats TextureAtlas::Stats() const
+{
+	TextureAtlasStats stats;
+	stats.pages = (int)pages.size();
+	stats.page_pixels = std::size_t(page_size[0]) * page_size[1] * pages.size();
+	stats.pack_seconds = pack_seconds;
+	for (auto const& entry : entries)
+	{
+		if (!entry.alive) continue;
+		stats.images++;
+		stats.used_pixels += std::size_t(entry.region.rect[2]) * entry.region.rect[3];
+	}
+	return stats;
+}
+
+} // !Mathyw
@@ -0,0 +1,159 @@
+#include <Mathyw/texture_loader.hpp>
+#include <Mathyw/state_cache.hpp>
+#include <chrono>
+#include <algorithm>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <stb/stb_image.h>
+
+namespace Mathyw {
+
+AsyncTexture::~AsyncTexture()
+{
+	if (pixels) stbi_image_free(pixels);
+}
+
+TextureLoader::TextureLoader(unsigned threads, std::size_t chunk_size)
+	: chunk_size(chunk_size), pending(0), stop(false)
+{
+	if (!threads) threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	glGenBuffers(1, &pbo);
+	for (unsigned i = 0; i < threads; i++)
+		workers.emplace_back(&TextureLoader::Work, this);
+}
+
+TextureLoader::~TextureLoader()
+{
+	{
+		std::lock_guard lock(mutex);
+		stop = true;
+	}
+	job_available.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+	glDeleteBuffers(1, &pbo);
+	GLStateCache::Current().BufferDeleted(pbo);
+}
+
+TextureHandle TextureLoader::Load(std::string const& path, int channels, bool flip, TextureDesc const& desc)
+{
+	auto texture = std::make_shared<AsyncTexture>();
+	texture->path = path;
+	texture->channels = channels;
+	texture->flip = flip;
+	texture->desc = desc;
+	pending.fetch_add(1, std::memory_order_release);
+	{
+		std::lock_guard lock(mutex);
+		jobs.push_back(texture);
+	}
+	job_available.notify_one();
+	return texture;
+}
+
+void TextureLoader::Work()
+{
+	while (true)
+	{
+		TextureHandle texture;
+		{
+			std::unique_lock lock(mutex);
+			job_available.wait(lock, [this] { return stop || !jobs.empty(); });
+			if (stop) return;
+			texture = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		// the flip setting and failure reason of stb_image are thread local
+		stbi_set_flip_vertically_on_load_thread(texture->flip);
+		int ch;
+		texture->pixels = stbi_load(texture->path.c_str(), &texture->size[0], &texture->size[1], &ch, texture->channels);
+		texture->components = texture->channels == 0 || ch < texture->channels ? ch : texture->channels;
+		if (!texture->pixels)
+		{
+			texture->err_message = std::string("Cannot load texture \"") + texture->path + "\": " + stbi_failure_reason();
+			{
+				// under the lock so Finish() cannot miss the wake up
+				std::lock_guard lock(mutex);
+				texture->status.store(TextureStatus::Failed, std::memory_order_release);
+				pending.fetch_sub(1, std::memory_order_release);
+			}
+			job_decoded.notify_all();
+			continue;
+		}
+
+		{
+			std::lock_guard lock(mutex);
+			decoded.push_back(std::move(texture));
+		}
+		job_decoded.notify_all();
+	}
+}
+
+void TextureLoader::UploadChunk()
+{
+	auto& texture = *uploading.front();
+	auto& state = GLStateCache::Current();
+	if (!texture.texture)
+	{
+		texture.texture = std::make_unique<Texture>(nullptr, texture.size, texture.components, texture.desc);
+		texture.status.store(TextureStatus::Uploading, std::memory_order_release);
+	}
+
+	std::size_t row_size = std::size_t(texture.size[0]) * texture.components;
+	int rows = std::clamp(int(chunk_size / std::max<std::size_t>(row_size, 1)), 1, texture.size[1] - texture.rows_uploaded);
+	std::size_t bytes = row_size * rows;
+
+	// orphan the buffer for each chunk so the driver never waits for the previous transfer
+	state.BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+	void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	std::memcpy(dst, texture.pixels + row_size * texture.rows_uploaded, bytes);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+	static constexpr GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+	state.BindTexture(GL_TEXTURE_2D, texture.texture->textureid);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, texture.rows_uploaded, texture.size[0], rows,
+		formats[texture.components - 1], GL_UNSIGNED_BYTE, nullptr);
+	// uploads of other textures read from client memory, never from the pixel buffer
+	state.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	texture.rows_uploaded += rows;
+	if (texture.rows_uploaded < texture.size[1]) return;
+	texture.texture->GenerateMipmaps(texture.pixels);
+	stbi_image_free(texture.pixels);
+	texture.pixels = nullptr;
+	texture.status.store(TextureStatus::Ready, std::memory_order_release);
+	pending.fetch_sub(1, std::memory_order_release);
+	uploading.pop_front();
+}
+
+void TextureLoader::Update(double budget)
+{
+	{
+		std::lock_guard lock(mutex);
+		std::move(decoded.begin(), decoded.end(), std::back_inserter(uploading));
+		decoded.clear();
+	}
+
+	using clock = std::chrono::steady_clock;
+	auto deadline = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(budget));
+	while (!uploading.empty())
+	{
+		UploadChunk();
+		if (clock::now() >= deadline) break;
+	}
+}
+
+void TextureLoader::Finish()
+{
+	while (Pending())
+	{
+		Update(1e9);
+		std::unique_lock lock(mutex);
+		job_decoded.wait(lock, [this] { return !decoded.empty() || !Pending(); });
+	}
+}
+
+} // !Mathyw
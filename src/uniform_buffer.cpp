@@ -0,0 +1,46 @@
+#include <Mathyw/uniform_buffer.hpp>
+#include <Mathyw/state_cache.hpp>
+#include <algorithm>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+namespace Mathyw {
+
+UniformBufferBase::UniformBufferBase(std::size_t size, std::uint32_t binding)
+	: binding(binding), content(size), destruct_this(true)
+{
+	auto& state = GLStateCache::Current();
+	glGenBuffers(1, &bufferid);
+	state.BindBuffer(GL_UNIFORM_BUFFER, bufferid);
+	glBufferData(GL_UNIFORM_BUFFER, size, content.data(), GL_DYNAMIC_DRAW);
+	state.BindBufferBase(GL_UNIFORM_BUFFER, binding, bufferid);
+}
+
+UniformBufferBase::UniformBufferBase(UniformBufferBase&& buffer) noexcept
+	: bufferid(buffer.bufferid), binding(buffer.binding), content(std::move(buffer.content)), destruct_this(true)
+{
+	buffer.destruct_this = false;
+}
+
+UniformBufferBase::~UniformBufferBase()
+{
+	if (!destruct_this) return;
+	glDeleteBuffers(1, &bufferid);
+	GLStateCache::Current().BufferDeleted(bufferid);
+}
+
+void UniformBufferBase::Upload(std::span<std::byte const> data, std::size_t offset)
+{
+	MATHYW_ASSERT(offset + data.size() <= content.size(), "UniformBuffer upload exceeds the buffer size");
+	if (std::equal(data.begin(), data.end(), content.begin() + offset)) return;
+	std::copy(data.begin(), data.end(), content.begin() + offset);
+	GLStateCache::Current().BindBuffer(GL_UNIFORM_BUFFER, bufferid);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, data.size(), data.data());
+}
+
+void UniformBufferBase::Bind()
+{
+	GLStateCache::Current().BindBufferBase(GL_UNIFORM_BUFFER, binding, bufferid);
+}
+
+} // !Mathyw
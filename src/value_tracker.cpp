@@ -1,20 +1,60 @@
 #include <Mathyw/value_tracker.hpp>
 #include <Mathyw/numeric.hpp>
+#include <atomic>
 
 namespace Mathyw {
 
+static std::atomic<int> active_trackers = 0;
+
 ValueTracker::ValueTracker(float init)
-	: value(init), now(0.0f), length(0.0f)
+	: value(init), now(0.0f), length(0.0f), looping(false), counted(false)
 {
 	tasklist.reserve(10);
 }
 
+ValueTracker::ValueTracker(ValueTracker const& tracker)
+	: value(tracker.value), now(tracker.now), length(tracker.length), tasklist(tracker.tasklist),
+	looping(tracker.looping), counted(false)
+{
+	Track();
+}
+
+ValueTracker& ValueTracker::operator=(ValueTracker const& tracker)
+{
+	value = tracker.value;
+	now = tracker.now;
+	length = tracker.length;
+	tasklist = tracker.tasklist;
+	looping = tracker.looping;
+	Track();
+	return *this;
+}
+
+ValueTracker::~ValueTracker()
+{
+	if (counted) active_trackers--;
+}
+
+void ValueTracker::Track()
+{
+	bool active = !tasklist.empty() && (looping || now <= length);
+	if (active == counted) return;
+	counted = active;
+	active_trackers += active ? 1 : -1;
+}
+
+int ValueTracker::ActiveCount()
+{
+	return active_trackers;
+}
+
 void ValueTracker::Set(float target, float duration, EasingFunction const& easing)
 {
 	MATHYW_ASSERT(duration >= 0.0f,
 		"The \"duration\" parameter of \"ValueTracker::Set\" must be non-negative");
 	tasklist.emplace_back(target, 0.0f, length, duration, easing, true);
 	length += duration;
+	Track();
 }
 
 void ValueTracker::Set(float target, EasingFunction const& easing)
@@ -27,6 +67,7 @@ void ValueTracker::Wait(float duration)
 	MATHYW_ASSERT(duration >= 0.0f,
 		"The \"duration\" parameter of \"ValueTracker::Wait\" must be non-negative");
 	length += duration;
+	Track();
 }
 
 void ValueTracker::Update(float elapsed, bool loop)
@@ -51,6 +92,8 @@ void ValueTracker::Update(float elapsed, bool loop)
 		for (auto& task : tasklist)
 			task.first_call = true;
 	}
+	looping = loop;
+	Track();
 }
 
 float ValueTracker::Get() const
@@ -1,47 +1,151 @@
 #include <Mathyw/vertex_array.hpp>
+#include <Mathyw/state_cache.hpp>
+#include <cstring>
+#include <limits>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 namespace Mathyw {
 
-void VertexLayout::Add(int count)
+int AttribSize(AttribType type, int count)
 {
-	attributes.emplace_back(count, stride);
-	stride += count;
+	switch (type)
+	{
+	case AttribType::Int8: case AttribType::Uint8:
+	case AttribType::Int8Norm: case AttribType::Uint8Norm:
+		return count;
+	case AttribType::Half:
+	case AttribType::Int16: case AttribType::Uint16:
+	case AttribType::Int16Norm: case AttribType::Uint16Norm:
+		return count * 2;
+	case AttribType::Int2_10_10_10: case AttribType::Uint2_10_10_10:
+		return 4;
+	default:
+		return count * 4;
+	}
+}
+
+void VertexLayout::Add(int count, AttribType type)
+{
+	MATHYW_ASSERT(count >= 1 && count <= 4, "Vertex attribute count must be 1 to 4");
+	MATHYW_ASSERT(count == 4 || (type != AttribType::Int2_10_10_10 && type != AttribType::Uint2_10_10_10),
+		"Packed 2_10_10_10 attributes must have 4 components");
+	attributes.emplace_back(count, stride, type);
+	stride += AttribSize(type, count);
+}
+
+static BufferUploadStats upload_stats;
+
+static constexpr GLenum buffer_usage(BufferUsage usage)
+{
+	switch (usage)
+	{
+	case BufferUsage::Dynamic: return GL_DYNAMIC_DRAW;
+	case BufferUsage::Stream: return GL_STREAM_DRAW;
+	default: return GL_STATIC_DRAW;
+	}
+}
+
+static constexpr GLenum attrib_type(AttribType type)
+{
+	switch (type)
+	{
+	case AttribType::Half: return GL_HALF_FLOAT;
+	case AttribType::Int8: case AttribType::Int8Norm: return GL_BYTE;
+	case AttribType::Uint8: case AttribType::Uint8Norm: return GL_UNSIGNED_BYTE;
+	case AttribType::Int16: case AttribType::Int16Norm: return GL_SHORT;
+	case AttribType::Uint16: case AttribType::Uint16Norm: return GL_UNSIGNED_SHORT;
+	case AttribType::Int32: return GL_INT;
+	case AttribType::Uint32: return GL_UNSIGNED_INT;
+	case AttribType::Int2_10_10_10: return GL_INT_2_10_10_10_REV;
+	case AttribType::Uint2_10_10_10: return GL_UNSIGNED_INT_2_10_10_10_REV;
+	default: return GL_FLOAT;
+	}
+}
+
+// Specify the attribute pointers of the buffer currently bound to GL_ARRAY_BUFFER
+// @param base: byte offset of the first vertex inside the buffer
+static void vertex_attrib_pointers(VertexLayout const& layout, std::uint32_t attribloc, std::size_t base)
+{
+	for (auto i = 0u; i < layout.attributes.size(); i++)
+	{
+		auto const& attrib = layout.attributes[i];
+		void* offset = (void*)(base + attrib.offset);
+		switch (attrib.type)
+		{
+		case AttribType::Int8: case AttribType::Uint8:
+		case AttribType::Int16: case AttribType::Uint16:
+		case AttribType::Int32: case AttribType::Uint32:
+			glVertexAttribIPointer(attribloc + i, attrib.count, attrib_type(attrib.type), layout.stride, offset);
+			break;
+		case AttribType::Float: case AttribType::Half:
+			glVertexAttribPointer(attribloc + i, attrib.count, attrib_type(attrib.type), false, layout.stride, offset);
+			break;
+		default: // normalized and packed types
+			glVertexAttribPointer(attribloc + i, attrib.count, attrib_type(attrib.type), true, layout.stride, offset);
+			break;
+		}
+	}
+}
+
+// Block until the gpu has finished reading a ring region, counts a stall if it has not
+static void wait_fence(void*& fence)
+{
+	if (!fence) return;
+	GLsync sync = (GLsync)fence;
+	GLenum res = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (res == GL_TIMEOUT_EXPIRED)
+	{
+		upload_stats.stalls++;
+		do res = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		while (res == GL_TIMEOUT_EXPIRED);
+	}
+	glDeleteSync(sync);
+	fence = nullptr;
 }
 
+static VertexArray* binded_vao = nullptr;
+
 VertexArray::VertexArray(int count, Primitives primitive)
-	: iboid(0), attribloc(0), count_indices(count), primitives(primitive), elem_to_draw(count), destruct_this(true)
+	: iboid(0), attribloc(0), index_type(GL_UNSIGNED_INT), count_indices(count), primitives(primitive), elem_to_draw(count), destruct_this(true)
 {
 	glGenVertexArrays(1, &vaoid);
-	vboids.reserve(2);
+	vbos.reserve(2);
 }
 
 VertexArray::VertexArray(VertexArray&& vao) noexcept
-	: vaoid(vao.vaoid), iboid(vao.iboid), attribloc(vao.attribloc),
+	: vaoid(vao.vaoid), iboid(vao.iboid), vbos(std::move(vao.vbos)), attribloc(vao.attribloc), index_type(vao.index_type),
 	count_indices(vao.count_indices), primitives(vao.primitives), elem_to_draw(vao.elem_to_draw), destruct_this(true)
 {
 	vao.destruct_this = false;
+	if (binded_vao == &vao) binded_vao = this;
 }
 
 VertexArray::~VertexArray()
 {
 	if (!destruct_this) return;
+	auto& state = GLStateCache::Current();
+	if (binded_vao == this) binded_vao = nullptr;
 	glDeleteVertexArrays(1, &vaoid);
-	for (auto& buffer : vboids)
-		glDeleteBuffers(1, &buffer);
+	state.VertexArrayDeleted(vaoid);
+	for (auto& buffer : vbos)
+	{
+		for (auto fence : buffer.fences)
+			if (fence) glDeleteSync((GLsync)fence);
+		glDeleteBuffers(1, &buffer.id);
+		state.BufferDeleted(buffer.id);
+	}
 	if (iboid)
+	{
 		glDeleteBuffers(1, &iboid);
+		state.BufferDeleted(iboid);
+	}
 }
 
-static VertexArray* binded_vao = nullptr;
-
 void VertexArray::Bind(VertexArray* vao)
 {
-	if (vao == binded_vao) return;
 	binded_vao = vao;
-	if (vao) glBindVertexArray(vao->vaoid);
-	else glBindVertexArray(0);
+	GLStateCache::Current().BindVertexArray(vao ? vao->vaoid : 0);
 }
 
 VertexArray* VertexArray::Current()
@@ -54,46 +158,174 @@ void VertexArray::Bind()
 	Bind(this);
 }
 
-void VertexArray::LinkVBO(float const* data, VertexLayout layout)
+void VertexArray::LinkVBO(std::span<std::byte const> data, VertexLayout layout, BufferUsage usage)
 {
-	MATHYW_ASSERT(data, "LinkVBO data cannot be null");
-	auto& vboid = vboids.emplace_back();
+	std::size_t bytes = std::size_t(layout.stride) * count_indices;
+	MATHYW_ASSERT(data.empty() || data.size() == bytes, "Illegal size of data in LinkVBO");
+	auto& vbo = vbos.emplace_back(0u, attribloc, 0u, usage, layout);
 	Bind();
-	glGenBuffers(1, &vboid);
-	glBindBuffer(GL_ARRAY_BUFFER, vboid);
-	glBufferData(GL_ARRAY_BUFFER, layout.stride * count_indices * sizeof(float), data, GL_STATIC_DRAW);
+	glGenBuffers(1, &vbo.id);
+	GLStateCache::Current().BindBuffer(GL_ARRAY_BUFFER, vbo.id);
 
-	for (auto i = 0u; i < layout.attributes.size(); i++)
+	if (usage == BufferUsage::Stream)
 	{
-		glEnableVertexAttribArray(attribloc + i);
-		auto const& attrib = layout.attributes[i];
-		glVertexAttribPointer(attribloc + i, attrib.count, GL_FLOAT, false,
-			layout.stride * sizeof(float), (void*)(attrib.offset * sizeof(float)));
+		// reserve every region of the ring up front, the first region holds the initial data
+		glBufferData(GL_ARRAY_BUFFER, bytes * stream_regions, nullptr, GL_STREAM_DRAW);
+		if (!data.empty()) glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data.data());
+		vbo.shadow.resize(bytes);
+		std::copy(data.begin(), data.end(), vbo.shadow.begin());
 	}
+	else glBufferData(GL_ARRAY_BUFFER, bytes, data.empty() ? nullptr : data.data(), buffer_usage(usage));
+
+	for (auto i = 0u; i < layout.attributes.size(); i++)
+		glEnableVertexAttribArray(attribloc + i);
+	vertex_attrib_pointers(layout, attribloc, 0);
 
 	attribloc += (std::uint32_t)layout.attributes.size();
-	Bind(nullptr);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void VertexArray::LinkIBO(unsigned const* data, std::uint32_t count)
+void VertexArray::LinkVBO(float const* data, VertexLayout layout, BufferUsage usage)
 {
-	MATHYW_ASSERT(data, "LinkIBO data cannot be null");
+	MATHYW_ASSERT(data, "LinkVBO data cannot be null");
+	LinkVBO(std::span((std::byte const*)data, std::size_t(layout.stride) * count_indices), layout, usage);
+}
+
+void VertexArray::UpdateVBO(int index, std::span<std::byte const> data, std::size_t offset)
+{
+	MATHYW_ASSERT(index >= 0 && index < (int)vbos.size(), "UpdateVBO index out of bounds");
+	auto& vbo = vbos[index];
+	std::size_t bytes = std::size_t(vbo.layout.stride) * count_indices;
+	MATHYW_ASSERT(offset + data.size() <= bytes, "UpdateVBO data exceeds the buffer size");
+	GLStateCache::Current().BindBuffer(GL_ARRAY_BUFFER, vbo.id);
+
+	switch (vbo.usage)
+	{
+	case BufferUsage::Static:
+		glBufferSubData(GL_ARRAY_BUFFER, offset, data.size(), data.data());
+		upload_stats.bytes += data.size();
+		break;
+
+	case BufferUsage::Dynamic:
+		// a full rewrite lets the driver hand out fresh storage instead of waiting on the old one
+		if (offset == 0 && data.size() == bytes)
+		{
+			glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_DYNAMIC_DRAW);
+			upload_stats.orphans++;
+		}
+		glBufferSubData(GL_ARRAY_BUFFER, offset, data.size(), data.data());
+		upload_stats.bytes += data.size();
+		break;
+
+	case BufferUsage::Stream:
+	{
+		// advance to the next region, which the gpu should have finished reading frames ago
+		vbo.region = (vbo.region + 1) % stream_regions;
+		wait_fence(vbo.fences[vbo.region]);
+		std::copy(data.begin(), data.end(), vbo.shadow.begin() + offset);
+		void* ptr = glMapBufferRange(GL_ARRAY_BUFFER, vbo.region * bytes, bytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		std::memcpy(ptr, vbo.shadow.data(), bytes);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		Bind();
+		vertex_attrib_pointers(vbo.layout, vbo.attribloc, vbo.region * bytes);
+		upload_stats.bytes += bytes;
+		break;
+	}
+	}
+
+	upload_stats.updates++;
+}
+
+// Narrow the indices into the requested type
+template<class Dst, class Src>
+static std::vector<Dst> narrow_indices(Src const* data, std::uint32_t count)
+{
+	std::vector<Dst> res(count);
+	for (std::uint32_t i = 0; i < count; i++)
+	{
+		MATHYW_ASSERT(data[i] <= std::numeric_limits<Dst>::max(), "Index does not fit in the index type of LinkIBO");
+		res[i] = (Dst)data[i];
+	}
+	return res;
+}
+
+void VertexArray::LinkIndices(void const* data, std::uint32_t count, std::uint32_t type)
+{
+	auto& state = GLStateCache::Current();
 	Bind();
-	if (iboid) glDeleteBuffers(1, &iboid);
+	if (iboid)
+	{
+		glDeleteBuffers(1, &iboid);
+		state.BufferDeleted(iboid);
+	}
 	glGenBuffers(1, &iboid);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iboid);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(unsigned int), data, GL_STATIC_DRAW);
-	Bind(nullptr);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	state.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, iboid);
+	std::size_t size = type == GL_UNSIGNED_BYTE ? 1 : type == GL_UNSIGNED_SHORT ? 2 : 4;
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, count * size, data, GL_STATIC_DRAW);
 	elem_to_draw = count;
+	index_type = type;
+}
+
+void VertexArray::LinkIBO(unsigned const* data, std::uint32_t count, IndexType type)
+{
+	MATHYW_ASSERT(data, "LinkIBO data cannot be null");
+	if (type == IndexType::Auto)
+	{
+		unsigned max = 0;
+		for (std::uint32_t i = 0; i < count; i++)
+			if (data[i] > max) max = data[i];
+		type = max <= 0xFFFF ? IndexType::Uint16 : IndexType::Uint32;
+	}
+
+	switch (type)
+	{
+	case IndexType::Uint8: LinkIndices(narrow_indices<std::uint8_t>(data, count).data(), count, GL_UNSIGNED_BYTE); break;
+	case IndexType::Uint16: LinkIndices(narrow_indices<std::uint16_t>(data, count).data(), count, GL_UNSIGNED_SHORT); break;
+	default: LinkIndices((void const*)data, count, GL_UNSIGNED_INT); break;
+	}
+}
+
+void VertexArray::LinkIBO(std::uint16_t const* data, std::uint32_t count, IndexType type)
+{
+	MATHYW_ASSERT(data, "LinkIBO data cannot be null");
+	switch (type)
+	{
+	case IndexType::Uint8: LinkIndices(narrow_indices<std::uint8_t>(data, count).data(), count, GL_UNSIGNED_BYTE); break;
+	case IndexType::Uint32: LinkIndices(narrow_indices<std::uint32_t>(data, count).data(), count, GL_UNSIGNED_INT); break;
+	default: LinkIndices((void const*)data, count, GL_UNSIGNED_SHORT); break;
+	}
+}
+
+void VertexArray::LinkIBO(std::uint8_t const* data, std::uint32_t count)
+{
+	MATHYW_ASSERT(data, "LinkIBO data cannot be null");
+	LinkIndices((void const*)data, count, GL_UNSIGNED_BYTE);
 }
 
 void VertexArray::Draw()
 {
 	Bind();
-	if (iboid) glDrawElements((unsigned)primitives, elem_to_draw, GL_UNSIGNED_INT, 0);
+	if (iboid) glDrawElements((unsigned)primitives, elem_to_draw, index_type, 0);
 	else glDrawArrays((unsigned)primitives, 0, count_indices);
+
+	// guard the regions just read so the ring never overwrites them in flight
+	for (auto& vbo : vbos)
+	{
+		if (vbo.usage != BufferUsage::Stream) continue;
+		auto& fence = vbo.fences[vbo.region];
+		if (fence) glDeleteSync((GLsync)fence);
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+}
+
+BufferUploadStats const& VertexArray::UploadStats()
+{
+	return upload_stats;
+}
+
+void VertexArray::ResetUploadStats()
+{
+	upload_stats = BufferUploadStats();
 }
 
-} // !Mathyw
\ No newline at end of file
+} // !Mathyw
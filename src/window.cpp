@@ -1,64 +1,79 @@
 #include <Mathyw/window.hpp>
 #include <Mathyw/opengl.hpp>
+#include <Mathyw/state_cache.hpp>
+#include <algorithm>
+#include <atomic>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
 namespace Mathyw {
 
+// Queue the event if the window queues events, otherwise call the callback right away
+template<class Ty>
+static void emit(WindowData& data, Ty const& event)
+{
+	if (data.queue) data.queue->Push(event);
+	else data.callback(event);
+}
+
 static void CreateWindowEventCallback(GLFWwindow* window)
 {
 	glfwSetKeyCallback(window,
 	[](GLFWwindow* window, int key, int scancode, int act, int modes) {
 		auto& data = *(WindowData*)glfwGetWindowUserPointer(window);
-		if (act != GLFW_REPEAT)
-			data.callback(KeyEvent(KeyCode(key), act == GLFW_PRESS));
+		if (act == GLFW_REPEAT) return;
+		data.input.Key(KeyCode(key), act == GLFW_PRESS);
+		emit(data, KeyEvent(KeyCode(key), act == GLFW_PRESS));
 	});
 
 	glfwSetMouseButtonCallback(window,
 	[](GLFWwindow* window, int button, int act, int modes) {
 		auto& data = *(WindowData*)glfwGetWindowUserPointer(window);
-		if (act != GLFW_REPEAT)
-			data.callback(MouseEvent(MouseButton(button), act == GLFW_PRESS));
+		if (act == GLFW_REPEAT) return;
+		data.input.Button(MouseButton(button), act == GLFW_PRESS);
+		emit(data, MouseEvent(MouseButton(button), act == GLFW_PRESS));
 	});
 
 	glfwSetCursorPosCallback(window,
 	[](GLFWwindow* window, double x, double y) {
 		auto& data = *(WindowData*)glfwGetWindowUserPointer(window);
 		Ivec2 res(x, y);
-		data.callback(MouseMovedEvent(res));
+		data.input.mouse = res;
+		emit(data, MouseMovedEvent(res));
 	});
 
 	glfwSetScrollCallback(window,
 	[](GLFWwindow* window, double x, double y) {
 		auto& data = *(WindowData*)glfwGetWindowUserPointer(window);
 		Ivec2 res(x, y);
-		data.callback(MouseScrolledEvent(res));
+		data.input.scroll += res;
+		emit(data, MouseScrolledEvent(res));
 	});
 
 	glfwSetWindowFocusCallback(window,
 	[](GLFWwindow* window, int focus) {
 		auto& data = *(WindowData*)glfwGetWindowUserPointer(window);
-		data.callback(WindowFocusedEvent(focus));
+		emit(data, WindowFocusedEvent(focus));
 	});
 
 	glfwSetWindowCloseCallback(window,
 	[](GLFWwindow* window) {
 		auto& data = *(WindowData*)glfwGetWindowUserPointer(window);
-		data.callback(WindowClosedEvent());
+		emit(data, WindowClosedEvent());
 	});
 
 	glfwSetWindowSizeCallback(window,
 	[](GLFWwindow* window, int width, int height) {
 		auto& data = *(WindowData*)glfwGetWindowUserPointer(window);
 		data.size = Ivec2(width, height);
-		data.callback(WindowResizedEvent(data.size));
+		emit(data, WindowResizedEvent(data.size));
 	});
 
 	glfwSetWindowPosCallback(window,
 	[](GLFWwindow* window, int x, int y) {
 		auto& data = *(WindowData*)glfwGetWindowUserPointer(window);
 		data.position = Ivec2(x, y);
-		data.callback(WindowMovedEvent(data.position));
+		emit(data, WindowMovedEvent(data.position));
 	});
 }
 
@@ -73,6 +88,45 @@ static void SetupWindowHints(std::uint8_t hint)
 	glfwWindowHint(GLFW_MAXIMIZED,		(bool)(hint & WindowMaximized));
 }
 
+// Create the window, retrying with the 3.3 context and, for headless windows, with other context APIs
+static GLFWwindow* create_window(int width, int height, std::string const& title, GLFWmonitor* monitor, std::uint8_t hint)
+{
+	SetupWindowHints(hint);
+	bool headless = hint & WindowHeadless;
+	if (headless) glfwWindowHint(GLFW_VISIBLE, false);
+#ifdef GLFW_PLATFORM_NULL
+	// the null platform has no native contexts
+	if (headless && glfwGetPlatform() == GLFW_PLATFORM_NULL)
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#endif
+
+	GLFWwindow* window = glfwCreateWindow(width, height, title.c_str(), monitor, nullptr);
+	if (!window) // the requested context version is unavailable
+	{
+		GLContextVersion(3, 3);
+		window = glfwCreateWindow(width, height, title.c_str(), monitor, nullptr);
+	}
+	if (!window && headless) // no display, e.g. on a server
+	{
+		for (int api : { GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API })
+		{
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, api);
+			if ((window = glfwCreateWindow(width, height, title.c_str(), monitor, nullptr))) break;
+		}
+	}
+	glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_NATIVE_CONTEXT_API);
+	return window;
+}
+
+// The window whose context is current on the thread, as the OpenGL context itself (see RenderThread)
+static thread_local Window* binded_window = nullptr;
+
+// When the events were last polled, the input of the frame being drawn (read by a render thread)
+static std::atomic<std::int64_t> last_poll = 0;
+
+// Safety margin of the low latency mode before the vertical blank
+static constexpr std::int64_t low_latency_margin = 1'000'000;
+
 Window::Window(int width, int height, std::string const& title, std::uint8_t hint)
 {
 	data.size = Ivec2(width, height);
@@ -82,19 +136,33 @@ Window::Window(int width, int height, std::string const& title, std::uint8_t hin
 	data.callback = [&](const Event& e) -> void { if (EventCast<WindowClosedEvent>(e)) Close(); };
 	data.viewport = { 0.0f, 0.0f, width, height };
 	data.cursor_mode = WindowCursorMode::Normal;
+	data.headless = hint & WindowHeadless;
+	data.redraw = true;
+	data.queue = nullptr;
+	input_state = std::make_unique<InputState>();
+	vsync_mode = VsyncMode::Off;
+	fence_index = 0;
+	low_latency = false;
+	last_swap = work_estimate = 0;
 	destruct_this = true;
 
 	InitGL();
-	SetupWindowHints(hint);
-	window = glfwCreateWindow(width, height, title.c_str(), nullptr, nullptr);
+	window = create_window(width, height, title, nullptr, hint);
+	MATHYW_ASSERT(window, "Window creation failed");
 	GLFWwindow* glwin = (GLFWwindow*) window;
-	glfwMakeContextCurrent(glwin);
+	Bind(this);
 	gladLoadGL();
+	if (data.headless) glfwSwapInterval(0);
 	glfwSetWindowUserPointer(glwin, &data);
-	glViewport(0, 0, width, height);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	auto& state = GLStateCache::Current();
+	state.Viewport(data.viewport);
+	state.Capability(GL_BLEND, true);
+	state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	CreateWindowEventCallback(glwin);
+	double x, y;
+	glfwGetCursorPos(glwin, &x, &y);
+	data.input.mouse = Ivec2(x, y);
+	PublishInput();
 }
 
 Window::Window(Monitor monitor, std::uint8_t hint)
@@ -102,42 +170,71 @@ Window::Window(Monitor monitor, std::uint8_t hint)
 	data.size = monitor.Size();
 	data.title = "";
 	data.active = true;
+	data.has_vsync = false;
 	data.callback = [&](const Event& e) -> void { if (EventCast<WindowClosedEvent>(e)) Close(); };
 	data.viewport = { 0.0f, 0.0f, monitor.Size()[0], monitor.Size()[1] };
 	data.cursor_mode = WindowCursorMode::Normal;
+	data.headless = false;
+	data.redraw = true;
+	data.queue = nullptr;
+	input_state = std::make_unique<InputState>();
+	vsync_mode = VsyncMode::Off;
+	fence_index = 0;
+	low_latency = false;
+	last_swap = work_estimate = 0;
 	destruct_this = true;
 
 	InitGL();
-	SetupWindowHints(hint);
-	window = glfwCreateWindow(monitor.Size()[0], monitor.Size()[1], "", (GLFWmonitor*) monitor.monitor, nullptr);
+	window = create_window(monitor.Size()[0], monitor.Size()[1], "", (GLFWmonitor*) monitor.monitor, hint & ~WindowHeadless);
+	MATHYW_ASSERT(window, "Window creation failed");
 	GLFWwindow* glwin = (GLFWwindow*) window;
-	glfwMakeContextCurrent(glwin);
+	Bind(this);
 	gladLoadGL();
 	glfwSetWindowUserPointer(glwin, &data);
-	glViewport(0, 0, monitor.Size()[0], monitor.Size()[1]);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	auto& state = GLStateCache::Current();
+	state.Viewport(data.viewport);
+	state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	CreateWindowEventCallback(glwin);
+	double x, y;
+	glfwGetCursorPos(glwin, &x, &y);
+	data.input.mouse = Ivec2(x, y);
+	PublishInput();
 }
 
 Window::Window(Window&& window) noexcept
-	: window(window.window), data(window.data), destruct_this(true)
+	: window(window.window), data(window.data), event_queue(std::move(window.event_queue)),
+	input_state(std::move(window.input_state)), vsync_mode(window.vsync_mode), fences(std::move(window.fences)),
+	fence_index(window.fence_index), low_latency(window.low_latency), last_swap(window.last_swap),
+	work_estimate(window.work_estimate), latency(window.latency), destruct_this(true)
 {
 	window.destruct_this = false;
+	glfwSetWindowUserPointer((GLFWwindow*) this->window, &data);
+	if (binded_window == &window) binded_window = this;
 }
 
 Window::~Window()
 {
-	if (destruct_this)
-		glfwDestroyWindow((GLFWwindow*) window);
+	if (!destruct_this) return;
+	if (!fences.empty())
+	{
+		// the fences belong to the context of this window
+		Window* previous = binded_window;
+		Bind(this);
+		FinishFrames();
+		Bind(previous);
+	}
+	if (binded_window == this) Bind(nullptr);
+	GLStateCache::Destroy(window);
+	glfwDestroyWindow((GLFWwindow*) window);
 }
 
-static Window* binded_window = nullptr;
-
 void Window::Bind(Window* window)
 {
 	if (binded_window == window) return;
-	if (window) glfwMakeContextCurrent((GLFWwindow*) window->window);
-	else glfwMakeContextCurrent(nullptr);
+	binded_window = window;
+	void* context = window ? window->window : nullptr;
+	glfwMakeContextCurrent((GLFWwindow*) context);
+	GLStateCache::MakeCurrent(context);
 }
 
 Window* Window::Current()
@@ -152,8 +249,109 @@ void Window::Bind()
 
 void Window::Update()
 {
-	glfwSwapBuffers((GLFWwindow*) window);
+	Present();
+	PollEvents();
+	PublishInput();
+}
+
+void Window::Present()
+{
+	std::int64_t input = last_poll;
+	if (low_latency || !fences.empty())
+	{
+		Bind(this);
+		// fenced before the swap, so the fence signals once the frame is drawn regardless of the vertical blank
+		FrameFence frame{ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), input };
+		if (low_latency)
+		{
+			FinishFrame(frame, ~0ull);
+			// fast rise, slow decay: a single slow frame pushes the start of the next frames earlier
+			if (input)
+			{
+				std::int64_t work = Clock::Now() - input;
+				work_estimate = std::max(work, work_estimate - (work_estimate - work) / 16);
+			}
+		}
+		else
+		{
+			// record the frames the gpu already finished, then wait for the oldest one if the ring is full
+			for (auto& old : fences)
+				if (old.fence) FinishFrame(old, 0);
+			auto& slot = fences[fence_index];
+			if (slot.fence) FinishFrame(slot, ~0ull);
+			slot = frame;
+			fence_index = (fence_index + 1) % fences.size();
+		}
+	}
+
+	if (!data.headless) glfwSwapBuffers((GLFWwindow*) window);
+	last_swap = Clock::Now();
+	// no latency before the events were ever polled, the time would count from the clock epoch
+	if (input) latency.present.Add(last_swap - input);
+}
+
+bool Window::FinishFrame(FrameFence& frame, std::uint64_t timeout)
+{
+	GLenum result = glClientWaitSync((GLsync)frame.fence, timeout ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, timeout);
+	if (result == GL_TIMEOUT_EXPIRED) return false;
+	if (frame.input) latency.complete.Add(Clock::Now() - frame.input);
+	glDeleteSync((GLsync)frame.fence);
+	frame.fence = nullptr;
+	return true;
+}
+
+void Window::FinishFrames()
+{
+	for (auto& frame : fences)
+		if (frame.fence) FinishFrame(frame, ~0ull);
+}
+
+std::int64_t Window::InputDeadline() const
+{
+	if (!low_latency || !data.has_vsync || !last_swap) return 0;
+	GLFWmonitor* monitor = glfwGetWindowMonitor((GLFWwindow*) window);
+	if (!monitor) monitor = glfwGetPrimaryMonitor();
+	GLFWvidmode const* mode = monitor ? glfwGetVideoMode(monitor) : nullptr;
+	std::int64_t period = 1'000'000'000 / (mode && mode->refreshRate > 0 ? mode->refreshRate : 60);
+	// the swap returned at a vertical blank, the next frame has to be drawn before the following one
+	return last_swap + period - work_estimate - low_latency_margin;
+}
+
+void Window::PollEvents()
+{
 	glfwPollEvents();
+	last_poll = Clock::Now();
+}
+
+void Window::WaitEvents(double timeout)
+{
+	if (timeout > 0.0) glfwWaitEventsTimeout(timeout);
+	else glfwWaitEvents();
+	last_poll = Clock::Now();
+}
+
+void Window::Wake()
+{
+	glfwPostEmptyEvent();
+}
+
+void Window::QueueEvents(std::size_t capacity, std::size_t custom_capacity)
+{
+	event_queue = std::make_unique<EventQueue>(capacity, custom_capacity);
+	data.queue = event_queue.get();
+}
+
+bool Window::Post(CustomEvent const& event)
+{
+	if (!event_queue || !event_queue->Post(event)) return false;
+	Wake();
+	return true;
+}
+
+void Window::RequestRedraw()
+{
+	data.redraw = true;
+	Wake();
 }
 
 void Window::Close()
@@ -191,14 +389,47 @@ void Window::Title(std::string const& title)
 
 void Window::Viewport(Ivec4 viewport)
 {
-	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	Bind(this);
+	GLStateCache::Current().Viewport(viewport);
 	data.viewport = viewport;
 }
 
 void Window::Vsync(bool enable)
 {
-	glfwSwapInterval(enable);
-	data.has_vsync = enable;
+	Vsync(enable ? VsyncMode::On : VsyncMode::Off);
+}
+
+void Window::Vsync(VsyncMode mode)
+{
+	Bind(this);
+	if (mode == VsyncMode::Adaptive
+		&& !glfwExtensionSupported("WGL_EXT_swap_control_tear")
+		&& !glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+		mode = VsyncMode::On;
+	glfwSwapInterval(mode == VsyncMode::Adaptive ? -1 : mode == VsyncMode::On);
+	data.has_vsync = mode != VsyncMode::Off;
+	vsync_mode = mode;
+}
+
+void Window::FramesInFlight(int count)
+{
+	MATHYW_ASSERT(count >= 0, "The frames in flight must be non-negative");
+	Bind(this);
+	FinishFrames();
+	fences.assign(count, FrameFence{ nullptr, 0 });
+	fence_index = 0;
+}
+
+void Window::LowLatency(bool enable)
+{
+	low_latency = enable;
+	work_estimate = 0;
+}
+
+void Window::ResetLatency()
+{
+	latency.present.Reset();
+	latency.complete.Reset();
 }
 
 void Window::CursorMode(WindowCursorMode mode)
@@ -243,6 +474,12 @@ void Window::CursorLook(WindowCursor cursor)
 
 #undef MATHYW_CURSOR_CASE
 
+void Window::PublishInput()
+{
+	input_state->Publish(data.input);
+	data.input.NextFrame();
+}
+
 bool Window::IsKeyPressed(KeyCode keycode) const
 {
 	return glfwGetKey((GLFWwindow*) window, keycode);
@@ -260,37 +497,40 @@ Ivec2 Window::MousePosition() const
 	return Ivec2(x, y);
 }
 
-#define MATHYW_ENABLE_TEST(cap, oglcap) if (caps & cap) glEnable(oglcap)
-#define MATHYW_DISABLE_TEST(cap, oglcap) if (caps & cap) glDisable(oglcap)
+#define MATHYW_CAPABILITY_TEST(cap, oglcap) if (caps & cap) state.Capability(oglcap, enable)
 
-static std::uint32_t opengl_capibilities;
+static void SetCapabilities(unsigned caps, bool enable)
+{
+	auto& state = GLStateCache::Current();
+	MATHYW_CAPABILITY_TEST(Blend, GL_BLEND);
+	MATHYW_CAPABILITY_TEST(DepthTest, GL_DEPTH_TEST);
+	MATHYW_CAPABILITY_TEST(CullFace, GL_CULL_FACE);
+	MATHYW_CAPABILITY_TEST(StencilTest, GL_STENCIL_TEST);
+	MATHYW_CAPABILITY_TEST(ScissorTest, GL_SCISSOR_TEST);
+}
+
+#undef MATHYW_CAPABILITY_TEST
 
 void Enable(unsigned caps)
 {
-	opengl_capibilities |= caps;
-	MATHYW_ENABLE_TEST(Blend, GL_BLEND);
-	MATHYW_ENABLE_TEST(DepthTest, GL_DEPTH_TEST);
-	MATHYW_ENABLE_TEST(CullFace, GL_CULL_FACE);
-	MATHYW_ENABLE_TEST(StencilTest, GL_STENCIL_TEST);
-	MATHYW_ENABLE_TEST(ScissorTest, GL_SCISSOR_TEST);
+	SetCapabilities(caps, true);
 }
 
 void Disable(unsigned caps)
 {
-	opengl_capibilities &= ~caps;
-	MATHYW_DISABLE_TEST(Blend, GL_BLEND);
-	MATHYW_DISABLE_TEST(DepthTest, GL_DEPTH_TEST);
-	MATHYW_DISABLE_TEST(CullFace, GL_CULL_FACE);
-	MATHYW_DISABLE_TEST(StencilTest, GL_STENCIL_TEST);
-	MATHYW_DISABLE_TEST(ScissorTest, GL_SCISSOR_TEST);
+	SetCapabilities(caps, false);
 }
 
 std::uint32_t Capabilities()
 {
-	return opengl_capibilities;
+	auto& state = GLStateCache::Current();
+	std::uint32_t caps = 0;
+	if (state.IsEnabled(GL_BLEND)) caps |= Blend;
+	if (state.IsEnabled(GL_DEPTH_TEST)) caps |= DepthTest;
+	if (state.IsEnabled(GL_CULL_FACE)) caps |= CullFace;
+	if (state.IsEnabled(GL_STENCIL_TEST)) caps |= StencilTest;
+	if (state.IsEnabled(GL_SCISSOR_TEST)) caps |= ScissorTest;
+	return caps;
 }
 
-#undef MATHYW_ENABLE_TEST
-#undef MATHYW_DISABLE_TEST
-
 } // !Mathyw
\ No newline at end of file